@@ -0,0 +1,107 @@
+#include <stdlib.h>
+
+#include "array.h"
+
+typedef unsigned long longtype;
+
+/* Return the storage currently holding the values of a. */
+static int *array_values(struct array *a) {
+    return a->data != NULL ? a->data : a->small;
+}
+
+struct array *array_init(unsigned long initial_capacity) {
+    struct array *new_array = malloc(sizeof(struct array));
+    if (new_array == NULL) {
+        return NULL;
+    }
+
+    array_init_embedded(new_array, 0);
+    if (initial_capacity <= ARRAY_INLINE) {
+        return new_array;
+    }
+
+    new_array->data = malloc(initial_capacity * sizeof(int));
+    if (new_array->data == NULL) {
+        free(new_array);
+        return NULL;
+    }
+    new_array->capacity = initial_capacity;
+
+    return new_array;
+}
+
+void array_init_embedded(struct array *a, int count_only) {
+    a->size = 0;
+    a->capacity = count_only ? ARRAY_COUNT_ONLY : 0;
+    a->data = NULL;
+}
+
+int array_get(const struct array *a, unsigned long index) {
+    if (a == NULL || index >= a->size || a->capacity == ARRAY_COUNT_ONLY) {
+        return -1;
+    }
+
+    return a->data != NULL ? a->data[index] : a->small[index];
+}
+
+int array_append(struct array *a, int elem) {
+    if (a == NULL) {
+        return 1;
+    }
+
+    if (a->capacity == ARRAY_COUNT_ONLY) {
+        a->size++;
+        return 0;
+    }
+
+    if (a->data == NULL && a->size == ARRAY_INLINE) {
+        /* Spill the inline values to a heap buffer. */
+        longtype new_capacity = ARRAY_INLINE * 4;
+        int *new_data = malloc(new_capacity * sizeof(int));
+        if (new_data == NULL) {
+            return 1;
+        }
+
+        for (longtype i = 0; i < a->size; i++) {
+            new_data[i] = a->small[i];
+        }
+        a->data = new_data;
+        a->capacity = new_capacity;
+    } else if (a->data != NULL && a->size == a->capacity) {
+        longtype new_capacity = a->capacity * 2;
+        int *new_data = realloc(a->data, new_capacity * sizeof(int));
+        if (new_data == NULL) {
+            return 1;
+        }
+
+        a->data = new_data;
+        a->capacity = new_capacity;
+    }
+
+    array_values(a)[a->size] = elem;
+    a->size++;
+
+    return 0;
+}
+
+unsigned long array_size(const struct array *a) {
+    return a->size;
+}
+
+void array_release(struct array *a) {
+    if (a == NULL) {
+        return;
+    }
+
+    free(a->data);
+    a->data = NULL;
+}
+
+void array_cleanup(struct array *a) {
+    if (a == NULL) {
+        return;
+    }
+
+    free(a->data);
+    free(a);
+}
@@ -0,0 +1,53 @@
+/* Do not edit this file! */
+
+/* Resizing array interface
+ * Specialized for integers. */
+
+/* Number of values stored inside struct array itself, before a separate
+ * buffer is allocated. */
+#define ARRAY_INLINE 2
+
+/* Array data structure. The definition is public so arrays can be embedded
+ * in other structs, only access it through the functions below. */
+struct array {
+    /* Number of values appended */
+    unsigned long size;
+    /* Capacity of 'data', 0 while the values fit in 'small' and
+     * ARRAY_COUNT_ONLY for arrays that only count appends */
+    unsigned long capacity;
+    /* Heap buffer once the values no longer fit in 'small', otherwise NULL */
+    int *data;
+    int small[ARRAY_INLINE];
+};
+
+/* Capacity marker of arrays initialised in counter-only mode. */
+#define ARRAY_COUNT_ONLY (~0UL)
+
+/* Initialise an array and return a pointer to it.
+ * Return NULL on failure. */
+struct array *array_init(unsigned long initial_capacity);
+
+/* Initialise an array embedded in another struct. No memory is allocated
+ * until more than ARRAY_INLINE values are appended. If count_only is 1 the
+ * array never stores values and only counts the number of appends. */
+void array_init_embedded(struct array *a, int count_only);
+
+/* Return the element at the index position in the array.
+ * Return -1 if the index is not a valid position in the array or if the
+ * array only counts appends. */
+int array_get(const struct array *a, unsigned long index);
+
+/* Add the element at the end of the array.
+ * Return 0 if successful, 1 otherwise. */
+int array_append(struct array *a, int elem);
+
+/* Return the number of elements in the array. If 'a' is NULL the return
+ * value is not defined. */
+unsigned long array_size(const struct array *a);
+
+/* Free the buffer of an array initialised with array_init_embedded(), the
+ * array itself is left to its owner. */
+void array_release(struct array *a);
+
+/* Cleanup array data structure. */
+void array_cleanup(struct array *a);
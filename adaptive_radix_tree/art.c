@@ -0,0 +1,1051 @@
+/*
+ * Adaptive radix tree (Leis, Kemper, Neumann: "The Adaptive Radix Tree:
+ * ARTful Indexing for Main-Memory Databases", ICDE 2013).
+ *
+ * Every inner node consumes one key byte to pick a child. Node4 and Node16
+ * keep sorted key bytes next to their children, Node16 is searched with one
+ * SSE2 compare. Node48 maps all 256 bytes to 48 child slots and Node256
+ * indexes its children directly. Nodes grow and shrink between these layouts
+ * as children come and go.
+ *
+ * Path compression: bytes shared by every key below a node are stored in the
+ * node as its prefix. Only the first MAX_PREFIX bytes are kept, lookups skip
+ * the rest and the final comparison against the full key in the leaf catches
+ * any mismatch. Inserts and scans that need the skipped bytes read them from
+ * any leaf below the node.
+ *
+ * Keys may be prefixes of other keys. A key that ends inside a node is stored
+ * in the 'end' leaf of that node instead of in a child.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "array.h"
+#include "art.h"
+
+#define NODE4 1
+#define NODE16 2
+#define NODE48 3
+#define NODE256 4
+
+/* Prefix bytes stored in a node, longer prefixes are only counted. */
+#define MAX_PREFIX 10
+
+typedef unsigned long longtype;
+
+struct leaf {
+    struct array value;
+    longtype key_len;
+    /* The key, followed by a NUL */
+    unsigned char key[];
+};
+
+/* Header shared by all inner node layouts. */
+struct node {
+    unsigned char type;
+    unsigned short num_children;
+    /* Number of bytes shared by all keys below this node */
+    longtype prefix_len;
+    /* The first min(prefix_len, MAX_PREFIX) of those bytes */
+    unsigned char prefix[MAX_PREFIX];
+    /* Leaf of the key that ends right after the prefix, or NULL */
+    struct leaf *end;
+};
+
+/* Children are tagged pointers, see is_leaf(). */
+struct node4 {
+    struct node n;
+    unsigned char keys[4];
+    void *children[4];
+};
+
+struct node16 {
+    struct node n;
+    unsigned char keys[16];
+    void *children[16];
+};
+
+struct node48 {
+    struct node n;
+    /* Index + 1 of the child for every key byte, 0 if there is none */
+    unsigned char index[256];
+    void *children[48];
+};
+
+struct node256 {
+    struct node n;
+    void *children[256];
+};
+
+struct art {
+    void *root;
+    longtype size;
+};
+
+/* Leaves are told apart from inner nodes by setting the lowest bit of their
+ * pointer, both are at least 2 byte aligned. */
+static int is_leaf(const void *p) {
+    return ((uintptr_t)p & 1) != 0;
+}
+
+static struct leaf *as_leaf(const void *p) {
+    return (struct leaf *)((uintptr_t)p & ~(uintptr_t)1);
+}
+
+static void *tag_leaf(struct leaf *l) {
+    return (void *)((uintptr_t)l | 1);
+}
+
+static longtype min_len(longtype a, longtype b) {
+    return a < b ? a : b;
+}
+
+static struct leaf *leaf_init(const unsigned char *key, longtype key_len) {
+    struct leaf *l = malloc(sizeof(struct leaf) + key_len + 1);
+    if (l == NULL) {
+        return NULL;
+    }
+
+    array_init_embedded(&l->value, 0);
+    l->key_len = key_len;
+    memcpy(l->key, key, key_len);
+    l->key[key_len] = '\0';
+    return l;
+}
+
+static void leaf_free(struct leaf *l) {
+    array_release(&l->value);
+    free(l);
+}
+
+static int leaf_matches(const struct leaf *l, const unsigned char *key,
+                        longtype key_len) {
+    return l->key_len == key_len && memcmp(l->key, key, key_len) == 0;
+}
+
+/* Compare the key of l with key, like memcmp() with shorter keys first. */
+static int leaf_compare(const struct leaf *l, const unsigned char *key,
+                        longtype key_len) {
+    int result = memcmp(l->key, key, min_len(l->key_len, key_len));
+    if (result != 0) {
+        return result;
+    }
+
+    return (l->key_len > key_len) - (l->key_len < key_len);
+}
+
+static struct node *node_init(unsigned char type) {
+    longtype size = type == NODE4 ? sizeof(struct node4)
+                    : type == NODE16 ? sizeof(struct node16)
+                    : type == NODE48 ? sizeof(struct node48)
+                    : sizeof(struct node256);
+
+    struct node *n = calloc(1, size);
+    if (n == NULL) {
+        return NULL;
+    }
+
+    n->type = type;
+    return n;
+}
+
+/* Copy prefix and end leaf of src into a node that replaces it. */
+static void copy_header(struct node *dst, const struct node *src) {
+    dst->num_children = src->num_children;
+    dst->prefix_len = src->prefix_len;
+    memcpy(dst->prefix, src->prefix, min_len(src->prefix_len, MAX_PREFIX));
+    dst->end = src->end;
+}
+
+/* Return the slot holding the child for key byte c, or NULL. */
+static void **find_child(struct node *n, unsigned char c) {
+    switch (n->type) {
+    case NODE4: {
+        struct node4 *n4 = (struct node4 *)n;
+        for (int i = 0; i < n->num_children; i++) {
+            if (n4->keys[i] == c) {
+                return &n4->children[i];
+            }
+        }
+        return NULL;
+    }
+    case NODE16: {
+        struct node16 *n16 = (struct node16 *)n;
+#ifdef __SSE2__
+        __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+                                     _mm_loadu_si128((const __m128i *)n16->keys));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(cmp)
+                            & ((1U << n->num_children) - 1);
+        return mask != 0 ? &n16->children[__builtin_ctz(mask)] : NULL;
+#else
+        for (int i = 0; i < n->num_children; i++) {
+            if (n16->keys[i] == c) {
+                return &n16->children[i];
+            }
+        }
+        return NULL;
+#endif
+    }
+    case NODE48: {
+        struct node48 *n48 = (struct node48 *)n;
+        return n48->index[c] != 0 ? &n48->children[n48->index[c] - 1] : NULL;
+    }
+    default: {
+        struct node256 *n256 = (struct node256 *)n;
+        return n256->children[c] != NULL ? &n256->children[c] : NULL;
+    }
+    }
+}
+
+/* Return the next child in key byte order, starting at cursor *pos which
+ * starts at 0, and store its key byte in *byte. Returns NULL after the last
+ * child. */
+static void *next_child(const struct node *n, int *pos, unsigned char *byte) {
+    switch (n->type) {
+    case NODE4: {
+        const struct node4 *n4 = (const struct node4 *)n;
+        if (*pos >= n->num_children) {
+            return NULL;
+        }
+        *byte = n4->keys[*pos];
+        return n4->children[(*pos)++];
+    }
+    case NODE16: {
+        const struct node16 *n16 = (const struct node16 *)n;
+        if (*pos >= n->num_children) {
+            return NULL;
+        }
+        *byte = n16->keys[*pos];
+        return n16->children[(*pos)++];
+    }
+    case NODE48: {
+        const struct node48 *n48 = (const struct node48 *)n;
+        while (*pos < 256) {
+            int c = (*pos)++;
+            if (n48->index[c] != 0) {
+                *byte = (unsigned char)c;
+                return n48->children[n48->index[c] - 1];
+            }
+        }
+        return NULL;
+    }
+    default: {
+        const struct node256 *n256 = (const struct node256 *)n;
+        while (*pos < 256) {
+            int c = (*pos)++;
+            if (n256->children[c] != NULL) {
+                *byte = (unsigned char)c;
+                return n256->children[c];
+            }
+        }
+        return NULL;
+    }
+    }
+}
+
+/* Return the smallest leaf below p. Every leaf below a node holds its full
+ * prefix, so this is also where skipped prefix bytes are read from. */
+static struct leaf *minimum(const void *p) {
+    while (!is_leaf(p)) {
+        const struct node *n = p;
+        if (n->end != NULL) {
+            return n->end;
+        }
+
+        int pos = 0;
+        unsigned char byte;
+        p = next_child(n, &pos, &byte);
+    }
+
+    return as_leaf(p);
+}
+
+/* Return the number of stored prefix bytes of n that match key at depth.
+ * Bytes beyond MAX_PREFIX are not checked. */
+static longtype check_prefix(const struct node *n, const unsigned char *key,
+                             longtype key_len, longtype depth) {
+    longtype max = min_len(min_len(n->prefix_len, MAX_PREFIX),
+                           key_len - depth);
+    longtype i = 0;
+    while (i < max && n->prefix[i] == key[depth + i]) {
+        i++;
+    }
+    return i;
+}
+
+/* Return the index of the first byte of the full prefix of n that differs
+ * from key at depth, or where key ends. Returns prefix_len if key holds the
+ * whole prefix. */
+static longtype prefix_mismatch(const struct node *n, const unsigned char *key,
+                                longtype key_len, longtype depth) {
+    longtype max = min_len(n->prefix_len, MAX_PREFIX);
+    for (longtype i = 0; i < max; i++) {
+        if (depth + i >= key_len || n->prefix[i] != key[depth + i]) {
+            return i;
+        }
+    }
+
+    if (n->prefix_len > MAX_PREFIX) {
+        const struct leaf *l = minimum(n);
+        for (longtype i = MAX_PREFIX; i < n->prefix_len; i++) {
+            if (depth + i >= key_len || l->key[depth + i] != key[depth + i]) {
+                return i;
+            }
+        }
+    }
+
+    return n->prefix_len;
+}
+
+static void add_child4(struct node4 *n4, unsigned char c, void *child) {
+    int pos = 0;
+    while (pos < n4->n.num_children && n4->keys[pos] < c) {
+        pos++;
+    }
+
+    memmove(n4->keys + pos + 1, n4->keys + pos,
+            (longtype)(n4->n.num_children - pos));
+    memmove(n4->children + pos + 1, n4->children + pos,
+            (longtype)(n4->n.num_children - pos) * sizeof(void *));
+    n4->keys[pos] = c;
+    n4->children[pos] = child;
+    n4->n.num_children++;
+}
+
+static void add_child16(struct node16 *n16, unsigned char c, void *child) {
+    int count = n16->n.num_children;
+#ifdef __SSE2__
+    /* SSE2 only compares signed bytes, flipping the top bit orders them as
+     * unsigned. */
+    __m128i flip = _mm_set1_epi8((char)0x80);
+    __m128i keys = _mm_xor_si128(_mm_loadu_si128((const __m128i *)n16->keys),
+                                 flip);
+    __m128i cmp = _mm_cmplt_epi8(keys, _mm_xor_si128(_mm_set1_epi8((char)c),
+                                                     flip));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(cmp)
+                        & ((1U << count) - 1);
+    int pos = __builtin_popcount(mask);
+#else
+    int pos = 0;
+    while (pos < count && n16->keys[pos] < c) {
+        pos++;
+    }
+#endif
+
+    memmove(n16->keys + pos + 1, n16->keys + pos, (longtype)(count - pos));
+    memmove(n16->children + pos + 1, n16->children + pos,
+            (longtype)(count - pos) * sizeof(void *));
+    n16->keys[pos] = c;
+    n16->children[pos] = child;
+    n16->n.num_children++;
+}
+
+static void add_child48(struct node48 *n48, unsigned char c, void *child) {
+    int pos = 0;
+    while (n48->children[pos] != NULL) {
+        pos++;
+    }
+
+    n48->children[pos] = child;
+    n48->index[c] = (unsigned char)(pos + 1);
+    n48->n.num_children++;
+}
+
+/* Add child for key byte c to the node at *ref, which must not have one for
+ * c yet. A full node is replaced by the next larger layout.
+ * Returns 0 if successful and -1 otherwise. */
+static int add_child(void **ref, unsigned char c, void *child) {
+    struct node *n = *ref;
+
+    switch (n->type) {
+    case NODE4: {
+        struct node4 *n4 = (struct node4 *)n;
+        if (n->num_children < 4) {
+            add_child4(n4, c, child);
+            return 0;
+        }
+
+        struct node16 *n16 = (struct node16 *)node_init(NODE16);
+        if (n16 == NULL) {
+            return -1;
+        }
+        copy_header(&n16->n, n);
+        memcpy(n16->keys, n4->keys, 4);
+        memcpy(n16->children, n4->children, 4 * sizeof(void *));
+        add_child16(n16, c, child);
+        *ref = n16;
+        free(n);
+        return 0;
+    }
+    case NODE16: {
+        struct node16 *n16 = (struct node16 *)n;
+        if (n->num_children < 16) {
+            add_child16(n16, c, child);
+            return 0;
+        }
+
+        struct node48 *n48 = (struct node48 *)node_init(NODE48);
+        if (n48 == NULL) {
+            return -1;
+        }
+        copy_header(&n48->n, n);
+        for (int i = 0; i < 16; i++) {
+            n48->children[i] = n16->children[i];
+            n48->index[n16->keys[i]] = (unsigned char)(i + 1);
+        }
+        add_child48(n48, c, child);
+        *ref = n48;
+        free(n);
+        return 0;
+    }
+    case NODE48: {
+        struct node48 *n48 = (struct node48 *)n;
+        if (n->num_children < 48) {
+            add_child48(n48, c, child);
+            return 0;
+        }
+
+        struct node256 *n256 = (struct node256 *)node_init(NODE256);
+        if (n256 == NULL) {
+            return -1;
+        }
+        copy_header(&n256->n, n);
+        for (int i = 0; i < 256; i++) {
+            if (n48->index[i] != 0) {
+                n256->children[i] = n48->children[n48->index[i] - 1];
+            }
+        }
+        n256->children[c] = child;
+        n256->n.num_children++;
+        *ref = n256;
+        free(n);
+        return 0;
+    }
+    default: {
+        struct node256 *n256 = (struct node256 *)n;
+        n256->children[c] = child;
+        n->num_children++;
+        return 0;
+    }
+    }
+}
+
+/* Replace a Node4 at *ref that no longer needs to be a node: with its end
+ * leaf if it has no children left, or with its only child if it has no end
+ * leaf, in which case the prefixes are joined. */
+static void compact(void **ref) {
+    struct node *n = *ref;
+    if (n->type != NODE4) {
+        return;
+    }
+
+    struct node4 *n4 = (struct node4 *)n;
+    if (n->num_children == 0) {
+        *ref = n->end != NULL ? tag_leaf(n->end) : NULL;
+        free(n);
+        return;
+    }
+
+    if (n->num_children > 1 || n->end != NULL) {
+        return;
+    }
+
+    void *child = n4->children[0];
+    if (!is_leaf(child)) {
+        /* The prefix of the child becomes: prefix of n, the key byte of the
+         * child, prefix of the child. */
+        struct node *c = child;
+        unsigned char prefix[MAX_PREFIX];
+        longtype len = min_len(n->prefix_len, MAX_PREFIX);
+
+        memcpy(prefix, n->prefix, len);
+        if (len < MAX_PREFIX) {
+            prefix[len++] = n4->keys[0];
+        }
+        longtype take = min_len(min_len(c->prefix_len, MAX_PREFIX),
+                                MAX_PREFIX - len);
+        memcpy(prefix + len, c->prefix, take);
+
+        c->prefix_len += n->prefix_len + 1;
+        memcpy(c->prefix, prefix, min_len(c->prefix_len, MAX_PREFIX));
+    }
+
+    *ref = child;
+    free(n);
+}
+
+/* Remove the child in slot for key byte c from the node at *ref. Nodes that
+ * became sparse are replaced by a smaller layout; if that fails the larger
+ * node is simply kept. */
+static void remove_child(void **ref, unsigned char c, void **slot) {
+    struct node *n = *ref;
+
+    switch (n->type) {
+    case NODE4: {
+        struct node4 *n4 = (struct node4 *)n;
+        int pos = (int)(slot - n4->children);
+        memmove(n4->keys + pos, n4->keys + pos + 1,
+                (longtype)(n->num_children - pos - 1));
+        memmove(n4->children + pos, n4->children + pos + 1,
+                (longtype)(n->num_children - pos - 1) * sizeof(void *));
+        n->num_children--;
+        compact(ref);
+        return;
+    }
+    case NODE16: {
+        struct node16 *n16 = (struct node16 *)n;
+        int pos = (int)(slot - n16->children);
+        memmove(n16->keys + pos, n16->keys + pos + 1,
+                (longtype)(n->num_children - pos - 1));
+        memmove(n16->children + pos, n16->children + pos + 1,
+                (longtype)(n->num_children - pos - 1) * sizeof(void *));
+        n->num_children--;
+
+        if (n->num_children == 3) {
+            struct node4 *n4 = (struct node4 *)node_init(NODE4);
+            if (n4 != NULL) {
+                copy_header(&n4->n, n);
+                memcpy(n4->keys, n16->keys, 3);
+                memcpy(n4->children, n16->children, 3 * sizeof(void *));
+                *ref = n4;
+                free(n);
+            }
+        }
+        return;
+    }
+    case NODE48: {
+        struct node48 *n48 = (struct node48 *)n;
+        n48->children[n48->index[c] - 1] = NULL;
+        n48->index[c] = 0;
+        n->num_children--;
+
+        if (n->num_children == 12) {
+            struct node16 *n16 = (struct node16 *)node_init(NODE16);
+            if (n16 != NULL) {
+                copy_header(&n16->n, n);
+                int pos = 0;
+                for (int i = 0; i < 256; i++) {
+                    if (n48->index[i] != 0) {
+                        n16->keys[pos] = (unsigned char)i;
+                        n16->children[pos++] = n48->children[n48->index[i] - 1];
+                    }
+                }
+                *ref = n16;
+                free(n);
+            }
+        }
+        return;
+    }
+    default: {
+        struct node256 *n256 = (struct node256 *)n;
+        n256->children[c] = NULL;
+        n->num_children--;
+
+        if (n->num_children == 37) {
+            struct node48 *n48 = (struct node48 *)node_init(NODE48);
+            if (n48 != NULL) {
+                copy_header(&n48->n, n);
+                int pos = 0;
+                for (int i = 0; i < 256; i++) {
+                    if (n256->children[i] != NULL) {
+                        n48->children[pos] = n256->children[i];
+                        n48->index[i] = (unsigned char)(++pos);
+                    }
+                }
+                *ref = n48;
+                free(n);
+            }
+        }
+        return;
+    }
+    }
+}
+
+struct art *art_init(void) {
+    struct art *t = malloc(sizeof(struct art));
+    if (t == NULL) {
+        return NULL;
+    }
+
+    t->root = NULL;
+    t->size = 0;
+    return t;
+}
+
+/* Put leaf l in node n4 at depth: in a child slot, or as the end leaf if the
+ * key ends there. */
+static void place_leaf(struct node4 *n4, struct leaf *l, longtype depth) {
+    if (l->key_len == depth) {
+        n4->n.end = l;
+    } else {
+        add_child4(n4, l->key[depth], tag_leaf(l));
+    }
+}
+
+/* Split a prefix or a leaf at *ref for a new key: a Node4 with the bytes
+ * both share as its prefix takes the old entry and the leaf of the new key.
+ * 'old' is the old leaf, or NULL if *ref is a node whose prefix differs from
+ * key after 'shared' bytes. Returns the new leaf, or NULL on failure. */
+static struct leaf *split(void **ref, struct leaf *old,
+                          const unsigned char *key, longtype key_len,
+                          longtype depth, longtype shared) {
+    struct leaf *l = leaf_init(key, key_len);
+    struct node4 *n4 = (struct node4 *)node_init(NODE4);
+    if (l == NULL || n4 == NULL) {
+        free(l);
+        free(n4);
+        return NULL;
+    }
+
+    n4->n.prefix_len = shared;
+    memcpy(n4->n.prefix, key + depth, min_len(shared, MAX_PREFIX));
+
+    if (old != NULL) {
+        place_leaf(n4, old, depth + shared);
+    } else {
+        /* The old node keeps the part of its prefix after the byte that now
+         * selects it. */
+        struct node *n = *ref;
+        unsigned char c;
+        if (n->prefix_len <= MAX_PREFIX) {
+            c = n->prefix[shared];
+            n->prefix_len -= shared + 1;
+            memmove(n->prefix, n->prefix + shared + 1,
+                    min_len(n->prefix_len, MAX_PREFIX));
+        } else {
+            const struct leaf *m = minimum(n);
+            c = m->key[depth + shared];
+            n->prefix_len -= shared + 1;
+            memcpy(n->prefix, m->key + depth + shared + 1,
+                   min_len(n->prefix_len, MAX_PREFIX));
+        }
+        add_child4(n4, c, n);
+    }
+
+    place_leaf(n4, l, depth + shared);
+    *ref = n4;
+    return l;
+}
+
+/* Return the leaf of key, inserting it if it is not present yet.
+ * Returns NULL on failure. */
+static struct leaf *insert(struct art *t, const unsigned char *key,
+                           longtype key_len) {
+    void **ref = &t->root;
+    longtype depth = 0;
+
+    for (;;) {
+        void *p = *ref;
+        if (p == NULL) {
+            struct leaf *l = leaf_init(key, key_len);
+            if (l == NULL) {
+                return NULL;
+            }
+            *ref = tag_leaf(l);
+            t->size++;
+            return l;
+        }
+
+        if (is_leaf(p)) {
+            struct leaf *old = as_leaf(p);
+            if (leaf_matches(old, key, key_len)) {
+                return old;
+            }
+
+            longtype max = min_len(old->key_len, key_len);
+            longtype shared = 0;
+            for (longtype i = depth; i < max && old->key[i] == key[i]; i++) {
+                shared++;
+            }
+
+            struct leaf *l = split(ref, old, key, key_len, depth, shared);
+            if (l != NULL) {
+                t->size++;
+            }
+            return l;
+        }
+
+        struct node *n = p;
+        if (n->prefix_len != 0) {
+            longtype shared = prefix_mismatch(n, key, key_len, depth);
+            if (shared < n->prefix_len) {
+                struct leaf *l = split(ref, NULL, key, key_len, depth, shared);
+                if (l != NULL) {
+                    t->size++;
+                }
+                return l;
+            }
+            depth += n->prefix_len;
+        }
+
+        if (depth == key_len) {
+            if (n->end == NULL) {
+                n->end = leaf_init(key, key_len);
+                if (n->end == NULL) {
+                    return NULL;
+                }
+                t->size++;
+            }
+            return n->end;
+        }
+
+        void **child = find_child(n, key[depth]);
+        if (child != NULL) {
+            ref = child;
+            depth++;
+            continue;
+        }
+
+        struct leaf *l = leaf_init(key, key_len);
+        if (l == NULL) {
+            return NULL;
+        }
+        if (add_child(ref, key[depth], tag_leaf(l)) != 0) {
+            leaf_free(l);
+            return NULL;
+        }
+        t->size++;
+        return l;
+    }
+}
+
+int art_insert(struct art *t, const char *key, unsigned long key_len,
+               int value) {
+    struct array *values = art_upsert(t, key, key_len);
+    if (values == NULL) {
+        return 1;
+    }
+
+    if (array_append(values, value) != 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+struct array *art_upsert(struct art *t, const char *key,
+                         unsigned long key_len) {
+    if (t == NULL || key == NULL) {
+        return NULL;
+    }
+
+    struct leaf *l = insert(t, (const unsigned char *)key, key_len);
+    if (l == NULL) {
+        return NULL;
+    }
+
+    return &l->value;
+}
+
+struct array *art_lookup(const struct art *t, const char *key,
+                         unsigned long key_len) {
+    if (t == NULL || key == NULL) {
+        return NULL;
+    }
+
+    const unsigned char *k = (const unsigned char *)key;
+    const void *p = t->root;
+    longtype depth = 0;
+
+    while (p != NULL) {
+        if (is_leaf(p)) {
+            struct leaf *l = as_leaf(p);
+            return leaf_matches(l, k, key_len) ? &l->value : NULL;
+        }
+
+        struct node *n = (struct node *)p;
+        if (n->prefix_len != 0) {
+            if (n->prefix_len > key_len - depth
+                || check_prefix(n, k, key_len, depth)
+                       != min_len(n->prefix_len, MAX_PREFIX)) {
+                return NULL;
+            }
+            depth += n->prefix_len;
+        }
+
+        if (depth == key_len) {
+            return n->end != NULL && leaf_matches(n->end, k, key_len)
+                       ? &n->end->value : NULL;
+        }
+
+        void **child = find_child(n, k[depth]);
+        p = child != NULL ? *child : NULL;
+        depth++;
+    }
+
+    return NULL;
+}
+
+int art_delete(struct art *t, const char *key, unsigned long key_len) {
+    if (t == NULL || key == NULL) {
+        return -1;
+    }
+
+    const unsigned char *k = (const unsigned char *)key;
+    void **ref = &t->root;
+    longtype depth = 0;
+
+    for (;;) {
+        void *p = *ref;
+        if (p == NULL) {
+            return 1;
+        }
+
+        if (is_leaf(p)) {
+            /* Only the root is reached as a leaf, leaves below a node are
+             * removed by their parent. */
+            if (!leaf_matches(as_leaf(p), k, key_len)) {
+                return 1;
+            }
+            leaf_free(as_leaf(p));
+            *ref = NULL;
+            t->size--;
+            return 0;
+        }
+
+        struct node *n = p;
+        if (n->prefix_len != 0) {
+            if (n->prefix_len > key_len - depth
+                || check_prefix(n, k, key_len, depth)
+                       != min_len(n->prefix_len, MAX_PREFIX)) {
+                return 1;
+            }
+            depth += n->prefix_len;
+        }
+
+        if (depth == key_len) {
+            if (n->end == NULL || !leaf_matches(n->end, k, key_len)) {
+                return 1;
+            }
+            leaf_free(n->end);
+            n->end = NULL;
+            t->size--;
+            compact(ref);
+            return 0;
+        }
+
+        void **child = find_child(n, k[depth]);
+        if (child == NULL) {
+            return 1;
+        }
+
+        if (is_leaf(*child)) {
+            struct leaf *l = as_leaf(*child);
+            if (!leaf_matches(l, k, key_len)) {
+                return 1;
+            }
+            remove_child(ref, k[depth], child);
+            leaf_free(l);
+            t->size--;
+            return 0;
+        }
+
+        ref = child;
+        depth++;
+    }
+}
+
+unsigned long art_size(const struct art *t) {
+    if (t == NULL) {
+        return 0;
+    }
+
+    return t->size;
+}
+
+struct walk {
+    int (*visit)(const char *, unsigned long, const struct array *, void *);
+    void *ctx;
+    /* Range bounds, hi is NULL for an open upper end */
+    const unsigned char *lo;
+    longtype lo_len;
+    const unsigned char *hi;
+    longtype hi_len;
+    /* Set once a key at or past hi was reached */
+    int stopped;
+};
+
+static int visit_leaf(const struct leaf *l, struct walk *w) {
+    if (w->hi != NULL && leaf_compare(l, w->hi, w->hi_len) >= 0) {
+        w->stopped = 1;
+        return 1;
+    }
+
+    return w->visit((const char *)l->key, l->key_len, &l->value, w->ctx);
+}
+
+/* Visit every key below p in order. If bounded is 1, all keys below p start
+ * with the first 'depth' bytes of lo and keys smaller than lo are skipped. */
+static int walk(const void *p, longtype depth, int bounded, struct walk *w) {
+    if (is_leaf(p)) {
+        const struct leaf *l = as_leaf(p);
+        if (bounded && leaf_compare(l, w->lo, w->lo_len) < 0) {
+            return 0;
+        }
+        return visit_leaf(l, w);
+    }
+
+    const struct node *n = p;
+    if (bounded) {
+        const unsigned char *prefix = n->prefix_len > MAX_PREFIX
+                                          ? minimum(n)->key + depth
+                                          : n->prefix;
+        for (longtype i = 0; i < n->prefix_len; i++) {
+            /* lo ends inside the prefix, so every key below is larger. */
+            if (depth + i == w->lo_len) {
+                bounded = 0;
+                break;
+            }
+            if (prefix[i] != w->lo[depth + i]) {
+                if (prefix[i] < w->lo[depth + i]) {
+                    return 0;
+                }
+                bounded = 0;
+                break;
+            }
+        }
+    }
+    depth += n->prefix_len;
+
+    /* The end leaf is the smallest key below n. While bounded it is a
+     * proper prefix of lo, or lo itself. */
+    if (bounded && depth == w->lo_len) {
+        bounded = 0;
+    }
+    if (n->end != NULL && !bounded) {
+        int result = visit_leaf(n->end, w);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    int pos = 0;
+    unsigned char c;
+    const void *child;
+    while ((child = next_child(n, &pos, &c)) != NULL) {
+        if (bounded && c < w->lo[depth]) {
+            continue;
+        }
+
+        int result = walk(child, depth + 1, bounded && c == w->lo[depth], w);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+int art_foreach(const struct art *t,
+                int (*visit)(const char *key, unsigned long key_len,
+                             const struct array *values, void *ctx),
+                void *ctx) {
+    return art_range(t, NULL, 0, NULL, 0, visit, ctx);
+}
+
+int art_prefix(const struct art *t, const char *prefix,
+               unsigned long prefix_len,
+               int (*visit)(const char *key, unsigned long key_len,
+                            const struct array *values, void *ctx),
+               void *ctx) {
+    if (t == NULL || prefix == NULL || visit == NULL) {
+        return -1;
+    }
+
+    struct walk w = {visit, ctx, NULL, 0, NULL, 0, 0};
+    const unsigned char *k = (const unsigned char *)prefix;
+    const void *p = t->root;
+    longtype depth = 0;
+
+    while (p != NULL) {
+        if (is_leaf(p)) {
+            const struct leaf *l = as_leaf(p);
+            if (l->key_len >= prefix_len
+                && memcmp(l->key, k, prefix_len) == 0) {
+                return visit_leaf(l, &w);
+            }
+            return 0;
+        }
+
+        const struct node *n = p;
+        if (n->prefix_len != 0) {
+            longtype shared = prefix_mismatch(n, k, prefix_len, depth);
+            if (shared < n->prefix_len) {
+                /* Either the prefix ends inside the node prefix, then every
+                 * key below matches, or no key below does. */
+                return depth + shared == prefix_len ? walk(n, depth, 0, &w) : 0;
+            }
+            depth += n->prefix_len;
+        }
+
+        if (depth == prefix_len) {
+            return walk(n, depth - n->prefix_len, 0, &w);
+        }
+
+        void **child = find_child((struct node *)n, k[depth]);
+        p = child != NULL ? *child : NULL;
+        depth++;
+    }
+
+    return 0;
+}
+
+int art_range(const struct art *t, const char *lo, unsigned long lo_len,
+              const char *hi, unsigned long hi_len,
+              int (*visit)(const char *key, unsigned long key_len,
+                           const struct array *values, void *ctx),
+              void *ctx) {
+    if (t == NULL || visit == NULL) {
+        return -1;
+    }
+
+    if (t->root == NULL) {
+        return 0;
+    }
+
+    struct walk w = {visit, ctx, (const unsigned char *)lo, lo_len,
+                     (const unsigned char *)hi, hi_len, 0};
+    int result = walk(t->root, 0, lo != NULL, &w);
+
+    return w.stopped ? 0 : result;
+}
+
+static void free_tree(void *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    if (is_leaf(p)) {
+        leaf_free(as_leaf(p));
+        return;
+    }
+
+    struct node *n = p;
+    if (n->end != NULL) {
+        leaf_free(n->end);
+    }
+
+    int pos = 0;
+    unsigned char c;
+    void *child;
+    while ((child = next_child(n, &pos, &c)) != NULL) {
+        free_tree(child);
+    }
+
+    free(n);
+}
+
+void art_cleanup(struct art *t) {
+    if (t == NULL) {
+        return;
+    }
+
+    free_tree(t->root);
+    free(t);
+}
@@ -0,0 +1,76 @@
+#ifndef ART_H
+#define ART_H
+
+/* Adaptive radix tree interface
+ * Ordered counterpart of the string hash table: every key maps to a
+ * resizing array of integers, which values are appended to. Keys are
+ * arbitrary byte strings and are kept in lexicographic (memcmp) order, with
+ * a key ordered before all keys it is a prefix of, so the tree answers
+ * ordered walks, prefix scans and range queries. Inner nodes adapt their
+ * layout to their number of children (4, 16, 48 or 256) and store the bytes
+ * shared by all keys below them only once. */
+
+struct array;
+
+/* Handle to adaptive radix tree data structure. */
+struct art;
+
+/* Return a pointer to a new empty tree. Return NULL on failure. */
+struct art *art_init(void);
+
+/* Copies and inserts key_len bytes at key as a key into the tree, together
+ * with the value. If the key is already present, the value is appended to
+ * its array instead. Returns 0 if successful and 1 otherwise. */
+int art_insert(struct art *t, const char *key, unsigned long key_len,
+               int value);
+
+/* Find-or-insert: returns the array of values of key, inserting a copy of
+ * the key with an empty array first if it is not present yet. The array
+ * stays valid until the key is deleted or the tree is cleaned up.
+ * Returns NULL if an error occured. */
+struct array *art_upsert(struct art *t, const char *key,
+                         unsigned long key_len);
+
+/* Returns the array of values of key.
+ * Returns NULL if the key is not present or if an error occured. */
+struct array *art_lookup(const struct art *t, const char *key,
+                         unsigned long key_len);
+
+/* Remove key and its values from the tree.
+ * Returns 0 if the key was removed, 1 if it was not present and -1 if an
+ * error occured. */
+int art_delete(struct art *t, const char *key, unsigned long key_len);
+
+/* Returns the number of keys in the tree. */
+unsigned long art_size(const struct art *t);
+
+/* Calls visit for every key in the tree in order, with the key, its length
+ * and its array of values. Keys are NUL-terminated. The tree must not be
+ * changed during the walk. Stops as soon as visit returns nonzero.
+ * Returns the last result of visit, or -1 if an error occured. */
+int art_foreach(const struct art *t,
+                int (*visit)(const char *key, unsigned long key_len,
+                             const struct array *values, void *ctx),
+                void *ctx);
+
+/* Same as art_foreach(), but only for the keys that start with the
+ * prefix_len bytes at prefix. Subtrees that cannot hold such keys are not
+ * visited. */
+int art_prefix(const struct art *t, const char *prefix,
+               unsigned long prefix_len,
+               int (*visit)(const char *key, unsigned long key_len,
+                            const struct array *values, void *ctx),
+               void *ctx);
+
+/* Same as art_foreach(), but only for the keys k with lo <= k < hi. A NULL
+ * lo or hi leaves that side of the range open. */
+int art_range(const struct art *t, const char *lo, unsigned long lo_len,
+              const char *hi, unsigned long hi_len,
+              int (*visit)(const char *key, unsigned long key_len,
+                           const struct array *values, void *ctx),
+              void *ctx);
+
+/* Free all memory associated with the tree. */
+void art_cleanup(struct art *t);
+
+#endif /* ART_H */
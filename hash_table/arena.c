@@ -0,0 +1,143 @@
+/*
+ * Implements an arena allocator: memory is bumped out of large slabs, which
+ * are kept in a singly linked list so they can be freed in one pass.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+#define DEFAULT_SLAB_SIZE (1UL << 20)
+
+/* Alignment of all allocations, enough for any scalar type. */
+#define ARENA_ALIGN 16
+
+typedef unsigned long longtype;
+
+struct slab {
+    struct slab *next;
+    longtype size;
+    /* Start of the usable memory, aligned to ARENA_ALIGN */
+    _Alignas(ARENA_ALIGN) unsigned char data[];
+};
+
+struct arena {
+    /* Slab that allocations are currently bumped from, head of the list */
+    struct slab *current;
+    /* Offset of the first free byte in the current slab */
+    longtype used;
+    longtype slab_size;
+    longtype footprint;
+};
+
+struct arena *arena_init(unsigned long slab_size) {
+    struct arena *a = malloc(sizeof(struct arena));
+    if (a == NULL) {
+        return NULL;
+    }
+
+    if (slab_size == 0) {
+        slab_size = DEFAULT_SLAB_SIZE;
+    }
+
+    a->current = NULL;
+    a->used = 0;
+    a->slab_size = slab_size;
+    a->footprint = sizeof(struct arena);
+
+    return a;
+}
+
+static struct slab *slab_new(struct arena *a, longtype size) {
+    struct slab *s = malloc(sizeof(struct slab) + size);
+    if (s == NULL) {
+        return NULL;
+    }
+
+    s->size = size;
+    a->footprint += sizeof(struct slab) + size;
+    return s;
+}
+
+/* Bump 'size' bytes aligned to 'align' (a power of two) out of the arena. */
+static void *arena_bump(struct arena *a, longtype size, longtype align) {
+    if (a == NULL) {
+        return NULL;
+    }
+
+    /* Large requests get a dedicated slab, linked in behind the current one
+     * so the free space left in the current slab is not wasted. */
+    if (size > a->slab_size / 4) {
+        struct slab *s = slab_new(a, size);
+        if (s == NULL) {
+            return NULL;
+        }
+
+        if (a->current == NULL) {
+            s->next = NULL;
+            a->current = s;
+            a->used = size;
+        } else {
+            s->next = a->current->next;
+            a->current->next = s;
+        }
+        return s->data;
+    }
+
+    longtype offset = (a->used + align - 1) & ~(align - 1);
+    if (a->current == NULL || offset + size > a->current->size) {
+        struct slab *s = slab_new(a, a->slab_size);
+        if (s == NULL) {
+            return NULL;
+        }
+
+        s->next = a->current;
+        a->current = s;
+        offset = 0;
+    }
+
+    void *p = a->current->data + offset;
+    a->used = offset + size;
+    return p;
+}
+
+void *arena_alloc(struct arena *a, unsigned long size) {
+    return arena_bump(a, size, ARENA_ALIGN);
+}
+
+char *arena_strndup(struct arena *a, const char *str, unsigned long len) {
+    /* Strings need no alignment, so keys are packed back to back. */
+    char *copy = arena_bump(a, len + 1, 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+unsigned long arena_footprint(const struct arena *a) {
+    if (a == NULL) {
+        return 0;
+    }
+
+    return a->footprint;
+}
+
+void arena_cleanup(struct arena *a) {
+    if (a == NULL) {
+        return;
+    }
+
+    struct slab *s = a->current;
+    while (s != NULL) {
+        struct slab *next = s->next;
+        free(s);
+        s = next;
+    }
+
+    free(a);
+}
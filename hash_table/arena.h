@@ -0,0 +1,27 @@
+/* Arena (slab) allocator interface
+ * Hands out memory from large slabs. Single allocations cannot be freed,
+ * all memory of an arena is released at once by arena_cleanup(). */
+
+/* Handle to arena data structure. */
+struct arena;
+
+/* Initialise an arena that allocates slabs of 'slab_size' bytes and return a
+ * pointer to it. A slab size of 0 selects a default size.
+ * Returns NULL on failure. */
+struct arena *arena_init(unsigned long slab_size);
+
+/* Returns a pointer to 'size' bytes of uninitialised memory, aligned for any
+ * type. Requests larger than a quarter slab get a slab of their own.
+ * Returns NULL on failure. */
+void *arena_alloc(struct arena *a, unsigned long size);
+
+/* Copies the first 'len' bytes of 'str' into the arena and terminates the
+ * copy with a NUL. Returns NULL on failure. */
+char *arena_strndup(struct arena *a, const char *str, unsigned long len);
+
+/* Returns the number of bytes the arena has allocated from the system. */
+unsigned long arena_footprint(const struct arena *a);
+
+/* Free every slab of the arena, then the arena itself. Runs in
+ * O(number of slabs). */
+void arena_cleanup(struct arena *a);
@@ -4,11 +4,10 @@
 
 typedef unsigned long longtype;
 
-struct array {
-    longtype size;
-    longtype capacity;
-    int *data;
-};
+/* Return the storage currently holding the values of a. */
+static int *array_values(struct array *a) {
+    return a->data != NULL ? a->data : a->small;
+}
 
 struct array *array_init(unsigned long initial_capacity) {
     struct array *new_array = malloc(sizeof(struct array));
@@ -16,23 +15,33 @@ struct array *array_init(unsigned long initial_capacity) {
         return NULL;
     }
 
+    array_init_embedded(new_array, 0);
+    if (initial_capacity <= ARRAY_INLINE) {
+        return new_array;
+    }
+
     new_array->data = malloc(initial_capacity * sizeof(int));
     if (new_array->data == NULL) {
         free(new_array);
         return NULL;
     }
-    new_array->size = 0;
     new_array->capacity = initial_capacity;
 
     return new_array;
 }
 
+void array_init_embedded(struct array *a, int count_only) {
+    a->size = 0;
+    a->capacity = count_only ? ARRAY_COUNT_ONLY : 0;
+    a->data = NULL;
+}
+
 int array_get(const struct array *a, unsigned long index) {
-    if (a == NULL || index >= a->size) {
+    if (a == NULL || index >= a->size || a->capacity == ARRAY_COUNT_ONLY) {
         return -1;
     }
 
-    return a->data[index];
+    return a->data != NULL ? a->data[index] : a->small[index];
 }
 
 int array_append(struct array *a, int elem) {
@@ -40,7 +49,25 @@ int array_append(struct array *a, int elem) {
         return 1;
     }
 
-    if (a->size == a->capacity) {
+    if (a->capacity == ARRAY_COUNT_ONLY) {
+        a->size++;
+        return 0;
+    }
+
+    if (a->data == NULL && a->size == ARRAY_INLINE) {
+        /* Spill the inline values to a heap buffer. */
+        longtype new_capacity = ARRAY_INLINE * 4;
+        int *new_data = malloc(new_capacity * sizeof(int));
+        if (new_data == NULL) {
+            return 1;
+        }
+
+        for (longtype i = 0; i < a->size; i++) {
+            new_data[i] = a->small[i];
+        }
+        a->data = new_data;
+        a->capacity = new_capacity;
+    } else if (a->data != NULL && a->size == a->capacity) {
         longtype new_capacity = a->capacity * 2;
         int *new_data = realloc(a->data, new_capacity * sizeof(int));
         if (new_data == NULL) {
@@ -51,16 +78,61 @@ int array_append(struct array *a, int elem) {
         a->capacity = new_capacity;
     }
 
-    a->data[a->size] = elem;
+    array_values(a)[a->size] = elem;
     a->size++;
 
     return 0;
 }
 
+int array_shrink_to_fit(struct array *a) {
+    if (a == NULL) {
+        return 1;
+    }
+
+    if (a->data == NULL || a->capacity == ARRAY_COUNT_ONLY
+        || a->size == a->capacity) {
+        return 0;
+    }
+
+    if (a->size <= ARRAY_INLINE) {
+        int *data = a->data;
+        for (longtype i = 0; i < a->size; i++) {
+            a->small[i] = data[i];
+        }
+        free(data);
+        a->data = NULL;
+        a->capacity = 0;
+        return 0;
+    }
+
+    int *new_data = realloc(a->data, a->size * sizeof(int));
+    if (new_data == NULL) {
+        return 1;
+    }
+
+    a->data = new_data;
+    a->capacity = a->size;
+
+    return 0;
+}
+
 unsigned long array_size(const struct array *a) {
     return a->size;
 }
 
+int array_count_only(const struct array *a) {
+    return a->capacity == ARRAY_COUNT_ONLY;
+}
+
+void array_release(struct array *a) {
+    if (a == NULL) {
+        return;
+    }
+
+    free(a->data);
+    a->data = NULL;
+}
+
 void array_cleanup(struct array *a) {
     if (a == NULL) {
         return;
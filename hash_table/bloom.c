@@ -0,0 +1,153 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "bloom.h"
+
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+/* Words per block, one bit is set in every word. */
+#define BLOCK_WORDS 8
+#define BLOCK_BITS (BLOCK_WORDS * 32)
+
+typedef unsigned long longtype;
+
+/* Odd multipliers that pick the bit of every word of a block. */
+static const uint32_t salts[BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+struct block {
+    uint32_t words[BLOCK_WORDS];
+};
+
+struct bloom {
+    /* Aligned to the block size, so no block straddles a cache line */
+    struct block *blocks;
+    longtype n_blocks;
+};
+
+/* Finalizer of MurmurHash3, spreads weak hashes over all 64 bits. */
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* The high half of the mixed hash selects the block, the low half the bits
+ * within it. */
+static const struct block *block_of(const struct bloom *b, uint64_t h) {
+    return &b->blocks[((h >> 32) * b->n_blocks) >> 32];
+}
+
+static void block_masks(uint32_t key, uint32_t *masks) {
+    for (int i = 0; i < BLOCK_WORDS; i++) {
+        masks[i] = 1U << ((key * salts[i]) >> 27);
+    }
+}
+
+struct bloom *bloom_init(unsigned long n_keys, unsigned long bits_per_key) {
+    struct bloom *b = malloc(sizeof(struct bloom));
+    if (b == NULL) {
+        return NULL;
+    }
+
+    /* The block index is computed from 32 bits. */
+    longtype n_blocks = (n_keys * bits_per_key + BLOCK_BITS - 1) / BLOCK_BITS;
+    if (n_blocks == 0) {
+        n_blocks = 1;
+    } else if (n_blocks > 0xffffffffUL) {
+        n_blocks = 0xffffffffUL;
+    }
+
+    b->blocks = aligned_alloc(sizeof(struct block),
+                              n_blocks * sizeof(struct block));
+    if (b->blocks == NULL) {
+        free(b);
+        return NULL;
+    }
+    memset(b->blocks, 0, n_blocks * sizeof(struct block));
+    b->n_blocks = n_blocks;
+
+    return b;
+}
+
+void bloom_add(struct bloom *b, unsigned long hash) {
+    uint64_t h = mix(hash);
+    struct block *block = (struct block *)block_of(b, h);
+    uint32_t masks[BLOCK_WORDS];
+
+    block_masks((uint32_t)h, masks);
+    for (int i = 0; i < BLOCK_WORDS; i++) {
+        block->words[i] |= masks[i];
+    }
+}
+
+int bloom_may_contain(const struct bloom *b, unsigned long hash) {
+    uint64_t h = mix(hash);
+    const struct block *block = block_of(b, h);
+
+#if defined(__AVX2__)
+    const __m256i salt = _mm256_loadu_si256((const __m256i *)salts);
+    __m256i bits = _mm256_srli_epi32(
+        _mm256_mullo_epi32(_mm256_set1_epi32((int)(uint32_t)h), salt), 27);
+    __m256i masks = _mm256_sllv_epi32(_mm256_set1_epi32(1), bits);
+    __m256i words = _mm256_load_si256((const __m256i *)block->words);
+    return _mm256_testc_si256(words, masks);
+#elif defined(__SSE2__)
+    uint32_t masks[BLOCK_WORDS];
+    block_masks((uint32_t)h, masks);
+    __m128i lo = _mm_andnot_si128(
+        _mm_load_si128((const __m128i *)block->words),
+        _mm_loadu_si128((const __m128i *)masks));
+    __m128i hi = _mm_andnot_si128(
+        _mm_load_si128((const __m128i *)(block->words + 4)),
+        _mm_loadu_si128((const __m128i *)(masks + 4)));
+    __m128i missing = _mm_or_si128(lo, hi);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128()))
+           == 0xffff;
+#else
+    uint32_t masks[BLOCK_WORDS];
+    uint32_t missing = 0;
+    block_masks((uint32_t)h, masks);
+    for (int i = 0; i < BLOCK_WORDS; i++) {
+        missing |= masks[i] & ~block->words[i];
+    }
+    return missing == 0;
+#endif
+}
+
+void bloom_prefetch(const struct bloom *b, unsigned long hash) {
+    PREFETCH(block_of(b, mix(hash)));
+}
+
+unsigned long bloom_footprint(const struct bloom *b) {
+    if (b == NULL) {
+        return 0;
+    }
+
+    return sizeof(struct bloom) + b->n_blocks * sizeof(struct block);
+}
+
+void bloom_cleanup(struct bloom *b) {
+    if (b == NULL) {
+        return;
+    }
+
+    free(b->blocks);
+    free(b);
+}
@@ -0,0 +1,30 @@
+/* Blocked Bloom filter interface
+ * Set membership filter over 64 bit hash values without false negatives.
+ * Every hash sets and tests 8 bits that all lie in one 32 byte block, so a
+ * query touches a single cache line and is checked with a few SIMD
+ * instructions. Hashes are remixed first, so weak hash functions can be
+ * used. Values cannot be removed, rebuild the filter instead. */
+
+/* Handle to Bloom filter data structure. */
+struct bloom;
+
+/* Initialise a filter for 'n_keys' keys with about 'bits_per_key' bits per
+ * key and return a pointer to it. 10 bits per key give a false positive rate
+ * of roughly 1%. Returns NULL on failure. */
+struct bloom *bloom_init(unsigned long n_keys, unsigned long bits_per_key);
+
+/* Add hash value to the filter. */
+void bloom_add(struct bloom *b, unsigned long hash);
+
+/* Returns 0 if hash was certainly never added to the filter, 1 if it may
+ * have been. */
+int bloom_may_contain(const struct bloom *b, unsigned long hash);
+
+/* Prefetch the block of hash, ahead of bloom_may_contain(). */
+void bloom_prefetch(const struct bloom *b, unsigned long hash);
+
+/* Returns the number of bytes used by the filter. */
+unsigned long bloom_footprint(const struct bloom *b);
+
+/* Clean up the filter. */
+void bloom_cleanup(struct bloom *b);
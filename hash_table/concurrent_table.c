@@ -0,0 +1,751 @@
+/*
+ * Implements a concurrent chaining hash table. Writers serialize per lock
+ * stripe, readers are lock-free. Unlinked memory is handed to an epoch based
+ * reclamation scheme: readers announce themselves in a counter of the current
+ * epoch parity, and the reclaimer flips the epoch and waits for the counters
+ * of the previous parity to drain before freeing anything retired earlier.
+ *
+ * A resize migrates incrementally, one bucket at a time. Starting it only
+ * publishes a new array whose buckets are all BUCKET_PENDING. An old bucket
+ * is migrated under its own stripe: its nodes are copied into the two new
+ * buckets it splits into, after which the old head is set to BUCKET_MOVED.
+ * Writers migrate the bucket they need first and then help with a few
+ * others, so no writer waits for more than a few buckets. Readers that find
+ * BUCKET_PENDING look in the older array, readers that find BUCKET_MOVED in
+ * the newer one. The shells left in the old chains are retired together
+ * with the old array once every bucket has moved.
+ *
+ * Limits: migrating copies every node once, one allocation per node. A
+ * bucket whose copy cannot be allocated stays in the old array until a
+ * writer of that bucket retries, and no further resize starts meanwhile.
+ * Memory is only retired and reclaimed outside the stripes, so waiting for
+ * readers never stalls writers, but a reclaim still waits for every reader
+ * of the previous epoch to finish.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "concurrent_table.h"
+
+/* Number of writer locks, a power of two. The stripe of a key only depends
+ * on its hash, so it does not change when the table resizes. */
+#define CTABLE_STRIPES 64
+
+/* Number of reader counters per epoch parity. Every thread is given its own
+ * counter on first use, round robin, so up to this many threads never share
+ * a cache line. */
+#define READER_SLOTS 64
+
+/* Number of old buckets every writer migrates while a resize runs, on top
+ * of the bucket it needs. Enough to finish a doubling before the new array
+ * reaches the load factor again. */
+#define MIGRATE_STEP 4
+
+/* Number of retired allocations after which a writer tries to reclaim. */
+#define RECLAIM_THRESHOLD 256
+
+#define CACHE_LINE 64
+
+/* Values of a key. Replaced by a copy when full, so readers can copy the
+ * values without locking. */
+struct cvalues {
+    unsigned long capacity;
+    /* Published with release after the value has been written */
+    _Atomic unsigned long size;
+    int data[];
+};
+
+struct cnode {
+    char *key;
+    unsigned long key_len;
+    unsigned long hash;
+    _Atomic(struct cvalues *) values;
+    _Atomic(struct cnode *) next;
+};
+
+struct cbuckets {
+    /* A power of two, at least CTABLE_STRIPES */
+    unsigned long capacity;
+    /* Array being migrated into this one, NULL once the resize finished */
+    _Atomic(struct cbuckets *) prev;
+    /* Next bucket of prev handed to a helping writer */
+    _Atomic unsigned long migrate_next;
+    /* Number of buckets of prev that have been migrated */
+    _Atomic unsigned long migrated;
+    /* Once this array is migrated: the array it moves to, and the chains
+     * moved out of every bucket, whose shells are retired with it */
+    struct cbuckets *next;
+    struct cnode **moved;
+    _Atomic(struct cnode *) heads[];
+};
+
+/* Head markers of buckets that have not been migrated into a new array yet,
+ * and of old buckets whose nodes have been migrated out. */
+static struct cnode bucket_pending;
+static struct cnode bucket_moved;
+#define BUCKET_PENDING (&bucket_pending)
+#define BUCKET_MOVED (&bucket_moved)
+
+/* What to free when a retired allocation is reclaimed. */
+enum retire_kind {
+    /* A deleted node, together with its key and values */
+    RETIRE_NODE,
+    /* A bucket array that has been migrated, with the node shells of its
+     * moved chains. Keys and values live on in the copies. */
+    RETIRE_BUCKETS,
+    /* A single allocation */
+    RETIRE_PLAIN
+};
+
+struct retired {
+    struct retired *next;
+    void *ptr;
+    enum retire_kind kind;
+};
+
+struct reader_slot {
+    _Alignas(CACHE_LINE) _Atomic unsigned long count[2];
+};
+
+struct ctable {
+    _Atomic(struct cbuckets *) buckets;
+    unsigned long (*hash_func)(const unsigned char *);
+    double max_load_factor;
+    _Atomic unsigned long load;
+
+    pthread_mutex_t stripes[CTABLE_STRIPES];
+    /* Serializes starting resizes, never held together with a stripe */
+    pthread_mutex_t resize_lock;
+
+    _Atomic unsigned long epoch;
+    struct reader_slot readers[READER_SLOTS];
+    /* Lock-free stack of retired allocations */
+    _Atomic(struct retired *) retired;
+    _Atomic unsigned long retired_count;
+    pthread_mutex_t reclaim_lock;
+};
+
+/* Hands out reader counters to threads, shared by all tables. */
+static _Atomic unsigned int next_reader_slot;
+
+/* Counter of this thread, READER_SLOTS until it is assigned. */
+static _Thread_local unsigned int reader_slot = READER_SLOTS;
+
+static unsigned int reader_slot_index(void) {
+    if (reader_slot == READER_SLOTS) {
+        reader_slot = atomic_fetch_add_explicit(&next_reader_slot, 1,
+                                                memory_order_relaxed)
+                      % READER_SLOTS;
+    }
+    return reader_slot;
+}
+
+/* Announce a reader and return its epoch parity, which must be passed to
+ * reader_exit(). */
+static unsigned int reader_enter(struct ctable *t, unsigned int slot) {
+    while (1) {
+        unsigned long e = atomic_load(&t->epoch);
+        atomic_fetch_add(&t->readers[slot].count[e & 1], 1);
+        /* If the epoch flipped in between, the reclaimer might not have seen
+         * this reader, so announce again in the new epoch. */
+        if (atomic_load(&t->epoch) == e) {
+            return (unsigned int)(e & 1);
+        }
+        atomic_fetch_sub(&t->readers[slot].count[e & 1], 1);
+    }
+}
+
+static void reader_exit(struct ctable *t, unsigned int slot,
+                        unsigned int parity) {
+    atomic_fetch_sub_explicit(&t->readers[slot].count[parity], 1,
+                              memory_order_release);
+}
+
+/* Free the nodes of a chain. Shells share their key and values with a copy
+ * in a newer array, so only the node itself is freed. */
+static void chain_free(struct cnode *n, int shells) {
+    while (n != NULL) {
+        struct cnode *following = atomic_load_explicit(&n->next,
+                                                       memory_order_relaxed);
+        if (!shells) {
+            free(atomic_load_explicit(&n->values, memory_order_relaxed));
+            free(n->key);
+        }
+        free(n);
+        n = following;
+    }
+}
+
+static void free_retired(struct retired *r) {
+    while (r != NULL) {
+        struct retired *rest = r->next;
+        if (r->kind == RETIRE_NODE) {
+            struct cnode *n = r->ptr;
+            free(atomic_load_explicit(&n->values, memory_order_relaxed));
+            free(n->key);
+        } else if (r->kind == RETIRE_BUCKETS) {
+            struct cbuckets *b = r->ptr;
+            for (unsigned long i = 0; i < b->capacity; i++) {
+                chain_free(b->moved[i], 1);
+            }
+            free(b->moved);
+        }
+        free(r->ptr);
+        free(r);
+        r = rest;
+    }
+}
+
+/* Free everything retired so far, once every reader that started before
+ * the allocations were unlinked has finished. Only one thread reclaims at a
+ * time, others return immediately. Must not be called with a stripe held. */
+static void reclaim(struct ctable *t) {
+    if (pthread_mutex_trylock(&t->reclaim_lock) != 0) {
+        return;
+    }
+
+    struct retired *list = atomic_exchange(&t->retired, NULL);
+    if (list == NULL) {
+        pthread_mutex_unlock(&t->reclaim_lock);
+        return;
+    }
+
+    unsigned long count = 0;
+    for (struct retired *r = list; r != NULL; r = r->next) {
+        count++;
+    }
+    atomic_fetch_sub(&t->retired_count, count);
+
+    unsigned long e = atomic_fetch_add(&t->epoch, 1);
+    for (unsigned int i = 0; i < READER_SLOTS; i++) {
+        while (atomic_load(&t->readers[i].count[e & 1]) != 0) {
+            sched_yield();
+        }
+    }
+
+    pthread_mutex_unlock(&t->reclaim_lock);
+    free_retired(list);
+}
+
+/* Hand an unlinked allocation to reclamation. May reclaim, so must not be
+ * called with a stripe held. */
+static void retire(struct ctable *t, void *ptr, enum retire_kind kind) {
+    struct retired *r = malloc(sizeof(struct retired));
+    if (r == NULL) {
+        /* Leaking is the only safe option without a record. */
+        return;
+    }
+
+    r->ptr = ptr;
+    r->kind = kind;
+    r->next = atomic_load(&t->retired);
+    while (!atomic_compare_exchange_weak(&t->retired, &r->next, r)) {
+    }
+
+    if (atomic_fetch_add(&t->retired_count, 1) + 1 >= RECLAIM_THRESHOLD) {
+        reclaim(t);
+    }
+}
+
+/* Allocate a bucket array with every head set to 'head'. */
+static struct cbuckets *buckets_new(unsigned long capacity,
+                                    struct cnode *head) {
+    struct cbuckets *b = malloc(sizeof(struct cbuckets)
+                                + capacity * sizeof(struct cnode *));
+    if (b == NULL) {
+        return NULL;
+    }
+
+    b->capacity = capacity;
+    atomic_init(&b->prev, NULL);
+    atomic_init(&b->migrate_next, 0);
+    atomic_init(&b->migrated, 0);
+    b->next = NULL;
+    b->moved = NULL;
+    for (unsigned long i = 0; i < capacity; i++) {
+        atomic_init(&b->heads[i], head);
+    }
+    return b;
+}
+
+struct ctable *ctable_init(unsigned long capacity,
+                           double max_load_factor,
+                           unsigned long (*hash_func)(const unsigned char *)) {
+    if (hash_func == NULL || max_load_factor <= 0.0) {
+        return NULL;
+    }
+
+    struct ctable *t = aligned_alloc(CACHE_LINE,
+                                     (sizeof(struct ctable) + CACHE_LINE - 1)
+                                         / CACHE_LINE * CACHE_LINE);
+    if (t == NULL) {
+        return NULL;
+    }
+
+    unsigned long cap = CTABLE_STRIPES;
+    while (cap < capacity) {
+        cap *= 2;
+    }
+
+    struct cbuckets *b = buckets_new(cap, NULL);
+    if (b == NULL) {
+        free(t);
+        return NULL;
+    }
+
+    atomic_init(&t->buckets, b);
+    t->hash_func = hash_func;
+    t->max_load_factor = max_load_factor;
+    atomic_init(&t->load, 0);
+    for (int i = 0; i < CTABLE_STRIPES; i++) {
+        pthread_mutex_init(&t->stripes[i], NULL);
+    }
+    pthread_mutex_init(&t->resize_lock, NULL);
+    pthread_mutex_init(&t->reclaim_lock, NULL);
+    atomic_init(&t->epoch, 0);
+    for (int i = 0; i < READER_SLOTS; i++) {
+        atomic_init(&t->readers[i].count[0], 0);
+        atomic_init(&t->readers[i].count[1], 0);
+    }
+    atomic_init(&t->retired, NULL);
+    atomic_init(&t->retired_count, 0);
+
+    return t;
+}
+
+/* Returns the node holding key in the chain starting at head, or NULL. */
+static struct cnode *chain_find(struct cnode *head, const char *key,
+                                unsigned long key_len, unsigned long hash) {
+    for (struct cnode *n = head; n != NULL;
+         n = atomic_load_explicit(&n->next, memory_order_acquire)) {
+        if (n->hash == hash && n->key_len == key_len
+            && memcmp(n->key, key, key_len) == 0) {
+            return n;
+        }
+    }
+
+    return NULL;
+}
+
+/* Migrate bucket k of the array being moved into b. Called with the stripe
+ * of k held, which is also the stripe of both new buckets it splits into.
+ * Returns 0 if the bucket has been migrated, 1 if it was the last one and
+ * the caller must call resize_finish() once the stripe is released, and -1
+ * if a copy could not be allocated. */
+static int bucket_migrate(struct cbuckets *b, unsigned long k) {
+    struct cbuckets *old = atomic_load_explicit(&b->prev,
+                                                memory_order_acquire);
+    struct cnode *chain = atomic_load_explicit(&old->heads[k],
+                                               memory_order_relaxed);
+    if (chain == BUCKET_MOVED) {
+        return 0;
+    }
+
+    /* Readers may be walking the old chain, so it is copied instead of
+     * relinked. */
+    struct cnode *split[2] = {NULL, NULL};
+    for (struct cnode *n = chain; n != NULL;
+         n = atomic_load_explicit(&n->next, memory_order_relaxed)) {
+        struct cnode *copy = malloc(sizeof(struct cnode));
+        if (copy == NULL) {
+            chain_free(split[0], 1);
+            chain_free(split[1], 1);
+            return -1;
+        }
+
+        int half = (n->hash & old->capacity) != 0;
+        copy->key = n->key;
+        copy->key_len = n->key_len;
+        copy->hash = n->hash;
+        atomic_init(&copy->values,
+                    atomic_load_explicit(&n->values, memory_order_relaxed));
+        atomic_init(&copy->next, split[half]);
+        split[half] = copy;
+    }
+
+    atomic_store_explicit(&b->heads[k], split[0], memory_order_release);
+    atomic_store_explicit(&b->heads[k + old->capacity], split[1],
+                          memory_order_release);
+    old->moved[k] = chain;
+    atomic_store_explicit(&old->heads[k], BUCKET_MOVED, memory_order_release);
+
+    return atomic_fetch_add(&b->migrated, 1) + 1 == old->capacity;
+}
+
+/* Retire the array that has been migrated into b, after its last bucket
+ * moved. Only called by the writer that migrated that bucket. */
+static void resize_finish(struct ctable *t, struct cbuckets *b) {
+    struct cbuckets *old = atomic_load_explicit(&b->prev,
+                                                memory_order_relaxed);
+    atomic_store_explicit(&b->prev, NULL, memory_order_release);
+    retire(t, old, RETIRE_BUCKETS);
+}
+
+/* Start doubling the bucket array if the load factor has been reached and
+ * no resize is running. Only allocates and publishes the new array, the
+ * buckets are migrated by later writers. */
+static void resize_start(struct ctable *t) {
+    pthread_mutex_lock(&t->resize_lock);
+
+    struct cbuckets *old = atomic_load(&t->buckets);
+    if ((double)atomic_load(&t->load) / (double)old->capacity
+            < t->max_load_factor
+        || atomic_load(&old->prev) != NULL) {
+        /* Another writer started a resize in the meantime. */
+        pthread_mutex_unlock(&t->resize_lock);
+        return;
+    }
+
+    struct cbuckets *b = buckets_new(old->capacity * 2, BUCKET_PENDING);
+    struct cnode **moved = calloc(old->capacity, sizeof(struct cnode *));
+    if (b == NULL || moved == NULL) {
+        /* The old array stays in use. */
+        free(b);
+        free(moved);
+        pthread_mutex_unlock(&t->resize_lock);
+        return;
+    }
+
+    old->moved = moved;
+    old->next = b;
+    atomic_init(&b->prev, old);
+    atomic_store_explicit(&t->buckets, b, memory_order_release);
+
+    pthread_mutex_unlock(&t->resize_lock);
+}
+
+/* Migrate up to MIGRATE_STEP buckets of a running resize. Runs as a reader,
+ * so the arrays cannot be reclaimed while it holds on to them. Must not be
+ * called with a stripe held. */
+static void resize_help(struct ctable *t) {
+    unsigned int slot = reader_slot_index();
+    unsigned int parity = reader_enter(t, slot);
+    struct cbuckets *b = atomic_load_explicit(&t->buckets,
+                                              memory_order_acquire);
+    struct cbuckets *old = atomic_load_explicit(&b->prev,
+                                                memory_order_acquire);
+    int finished = 0;
+
+    for (int i = 0; old != NULL && i < MIGRATE_STEP; i++) {
+        unsigned long k = atomic_fetch_add(&b->migrate_next, 1);
+        if (k >= old->capacity) {
+            break;
+        }
+
+        pthread_mutex_t *stripe = &t->stripes[k & (CTABLE_STRIPES - 1)];
+        pthread_mutex_lock(stripe);
+        if (atomic_load_explicit(&b->prev, memory_order_relaxed) == old
+            && bucket_migrate(b, k) == 1) {
+            finished = 1;
+        }
+        pthread_mutex_unlock(stripe);
+    }
+
+    reader_exit(t, slot, parity);
+    if (finished) {
+        resize_finish(t, b);
+    }
+}
+
+/* Lock the stripe of hash and return the bucket of hash in the current
+ * array, migrating it first if a resize is running. The array is stored in
+ * *bp. If the migrated bucket was the last one, *finish is set to 1 and the
+ * caller must call resize_finish() after releasing the stripe.
+ * Returns NULL, with the stripe released, if the bucket could not be
+ * migrated. */
+static _Atomic(struct cnode *) *bucket_lock(struct ctable *t,
+                                            unsigned long hash,
+                                            struct cbuckets **bp,
+                                            int *finish) {
+    pthread_mutex_t *stripe = &t->stripes[hash & (CTABLE_STRIPES - 1)];
+    pthread_mutex_lock(stripe);
+
+    /* A resize that starts after this load cannot migrate the bucket while
+     * the stripe is held, so it is safe to change it in this array. */
+    struct cbuckets *b = atomic_load_explicit(&t->buckets,
+                                              memory_order_acquire);
+    _Atomic(struct cnode *) *head = &b->heads[hash & (b->capacity - 1)];
+
+    *finish = 0;
+    if (atomic_load_explicit(head, memory_order_relaxed) == BUCKET_PENDING) {
+        struct cbuckets *old = atomic_load_explicit(&b->prev,
+                                                    memory_order_relaxed);
+        int result = bucket_migrate(b, hash & (old->capacity - 1));
+        if (result < 0) {
+            pthread_mutex_unlock(stripe);
+            return NULL;
+        }
+        *finish = result;
+    }
+
+    *bp = b;
+    return head;
+}
+
+/* Release the stripe taken by bucket_lock() and take part in a running
+ * resize. */
+static void bucket_unlock(struct ctable *t, unsigned long hash,
+                          struct cbuckets *b, int finish) {
+    pthread_mutex_unlock(&t->stripes[hash & (CTABLE_STRIPES - 1)]);
+    if (finish) {
+        resize_finish(t, b);
+    }
+    resize_help(t);
+}
+
+/* Append value to the values of n. Called with the stripe of n held. If the
+ * values were replaced by a larger copy, the old ones are stored in *old, to
+ * be retired once the stripe is released, and *old is NULL otherwise. */
+static int values_append(struct cnode *n, int value, struct cvalues **old) {
+    struct cvalues *v = atomic_load_explicit(&n->values, memory_order_relaxed);
+    unsigned long size = atomic_load_explicit(&v->size, memory_order_relaxed);
+
+    *old = NULL;
+    if (size < v->capacity) {
+        v->data[size] = value;
+        atomic_store_explicit(&v->size, size + 1, memory_order_release);
+        return 0;
+    }
+
+    struct cvalues *grown = malloc(sizeof(struct cvalues)
+                                   + v->capacity * 2 * sizeof(int));
+    if (grown == NULL) {
+        return 1;
+    }
+
+    grown->capacity = v->capacity * 2;
+    memcpy(grown->data, v->data, size * sizeof(int));
+    grown->data[size] = value;
+    atomic_init(&grown->size, size + 1);
+    atomic_store_explicit(&n->values, grown, memory_order_release);
+    *old = v;
+
+    return 0;
+}
+
+/* Create a node for key holding a single value. */
+static struct cnode *cnode_init(const char *key, unsigned long key_len,
+                                unsigned long hash, int value) {
+    struct cnode *n = malloc(sizeof(struct cnode));
+    if (n == NULL) {
+        return NULL;
+    }
+
+    n->key = malloc(key_len + 1);
+    struct cvalues *v = malloc(sizeof(struct cvalues) + 2 * sizeof(int));
+    if (n->key == NULL || v == NULL) {
+        free(n->key);
+        free(v);
+        free(n);
+        return NULL;
+    }
+
+    memcpy(n->key, key, key_len + 1);
+    n->key_len = key_len;
+    n->hash = hash;
+    v->capacity = 2;
+    v->data[0] = value;
+    atomic_init(&v->size, 1);
+    atomic_init(&n->values, v);
+    atomic_init(&n->next, NULL);
+
+    return n;
+}
+
+int ctable_insert(struct ctable *t, const char *key, int value) {
+    if (t == NULL || key == NULL) {
+        return 1;
+    }
+
+    unsigned long key_len = strlen(key);
+    unsigned long hash = t->hash_func((const unsigned char *)key);
+    struct cbuckets *b;
+    int finish;
+    _Atomic(struct cnode *) *head = bucket_lock(t, hash, &b, &finish);
+    if (head == NULL) {
+        return 1;
+    }
+
+    /* b may be retired as soon as the stripe is released. */
+    unsigned long capacity = b->capacity;
+    struct cnode *n = chain_find(atomic_load_explicit(head,
+                                                      memory_order_relaxed),
+                                 key, key_len, hash);
+    if (n != NULL) {
+        struct cvalues *old;
+        int result = values_append(n, value, &old);
+        bucket_unlock(t, hash, b, finish);
+        if (old != NULL) {
+            retire(t, old, RETIRE_PLAIN);
+        }
+        return result;
+    }
+
+    n = cnode_init(key, key_len, hash, value);
+    if (n == NULL) {
+        bucket_unlock(t, hash, b, finish);
+        return 1;
+    }
+
+    atomic_init(&n->next, atomic_load_explicit(head, memory_order_relaxed));
+    atomic_store_explicit(head, n, memory_order_release);
+    bucket_unlock(t, hash, b, finish);
+
+    unsigned long load = atomic_fetch_add(&t->load, 1) + 1;
+    if ((double)load / (double)capacity >= t->max_load_factor) {
+        resize_start(t);
+    }
+
+    return 0;
+}
+
+/* Returns the head of the bucket of hash, looking in older or newer arrays
+ * for buckets that are not or no longer stored in b. Called as a reader. */
+static struct cnode *bucket_head(struct cbuckets *b, unsigned long hash) {
+    while (1) {
+        struct cnode *head = atomic_load_explicit(
+            &b->heads[hash & (b->capacity - 1)], memory_order_acquire);
+        if (head == BUCKET_PENDING) {
+            /* If the resize finished in between, the bucket has moved by
+             * now. */
+            struct cbuckets *prev = atomic_load_explicit(&b->prev,
+                                                         memory_order_acquire);
+            if (prev != NULL) {
+                b = prev;
+            }
+        } else if (head == BUCKET_MOVED) {
+            b = b->next;
+        } else {
+            return head;
+        }
+    }
+}
+
+long ctable_lookup(struct ctable *t, const char *key, int *values,
+                   unsigned long max_values) {
+    if (t == NULL || key == NULL || (values == NULL && max_values > 0)) {
+        return -1;
+    }
+
+    unsigned long key_len = strlen(key);
+    unsigned long hash = t->hash_func((const unsigned char *)key);
+    unsigned int slot = reader_slot_index();
+    unsigned int parity = reader_enter(t, slot);
+
+    struct cbuckets *b = atomic_load_explicit(&t->buckets,
+                                              memory_order_acquire);
+    struct cnode *n = chain_find(bucket_head(b, hash), key, key_len, hash);
+
+    long result = -1;
+    if (n != NULL) {
+        struct cvalues *v = atomic_load_explicit(&n->values,
+                                                 memory_order_acquire);
+        unsigned long size = atomic_load_explicit(&v->size,
+                                                  memory_order_acquire);
+        unsigned long count = size < max_values ? size : max_values;
+        memcpy(values, v->data, count * sizeof(int));
+        result = (long)size;
+    }
+
+    reader_exit(t, slot, parity);
+    return result;
+}
+
+double ctable_load_factor(const struct ctable *t) {
+    if (t == NULL) {
+        return -1.0;
+    }
+
+    /* The bucket array may be retired by a resize, so read its capacity as
+     * a reader. Announcing a reader only touches the epoch counters. */
+    struct ctable *w = (struct ctable *)t;
+    unsigned int slot = reader_slot_index();
+    unsigned int parity = reader_enter(w, slot);
+    struct cbuckets *b = atomic_load_explicit(&w->buckets,
+                                              memory_order_acquire);
+    double load_factor = (double)atomic_load(&w->load) / (double)b->capacity;
+    reader_exit(w, slot, parity);
+
+    return load_factor;
+}
+
+int ctable_delete(struct ctable *t, const char *key) {
+    if (t == NULL || key == NULL) {
+        return -1;
+    }
+
+    unsigned long key_len = strlen(key);
+    unsigned long hash = t->hash_func((const unsigned char *)key);
+    struct cbuckets *b;
+    int finish;
+    _Atomic(struct cnode *) *link = bucket_lock(t, hash, &b, &finish);
+    if (link == NULL) {
+        return -1;
+    }
+
+    struct cnode *n = atomic_load_explicit(link, memory_order_relaxed);
+    while (n != NULL) {
+        if (n->hash == hash && n->key_len == key_len
+            && memcmp(n->key, key, key_len) == 0) {
+            /* Readers standing on n can still follow its next pointer. */
+            atomic_store_explicit(link,
+                                  atomic_load_explicit(&n->next,
+                                                       memory_order_relaxed),
+                                  memory_order_release);
+            bucket_unlock(t, hash, b, finish);
+
+            atomic_fetch_sub(&t->load, 1);
+            retire(t, n, RETIRE_NODE);
+            return 0;
+        }
+
+        link = &n->next;
+        n = atomic_load_explicit(link, memory_order_relaxed);
+    }
+
+    bucket_unlock(t, hash, b, finish);
+    return 1;
+}
+
+void ctable_cleanup(struct ctable *t) {
+    if (t == NULL) {
+        return;
+    }
+
+    free_retired(atomic_load(&t->retired));
+
+    /* During a resize, nodes of buckets that have not moved yet are only in
+     * the old array, and moved buckets left shells behind. */
+    struct cbuckets *b = atomic_load(&t->buckets);
+    struct cbuckets *old = atomic_load(&b->prev);
+    if (old != NULL) {
+        for (unsigned long i = 0; i < old->capacity; i++) {
+            struct cnode *n = atomic_load_explicit(&old->heads[i],
+                                                   memory_order_relaxed);
+            chain_free(n == BUCKET_MOVED ? old->moved[i] : n,
+                       n == BUCKET_MOVED);
+        }
+        free(old->moved);
+        free(old);
+    }
+
+    for (unsigned long i = 0; i < b->capacity; i++) {
+        struct cnode *n = atomic_load_explicit(&b->heads[i],
+                                               memory_order_relaxed);
+        if (n != BUCKET_PENDING) {
+            chain_free(n, 0);
+        }
+    }
+    free(b);
+
+    for (int i = 0; i < CTABLE_STRIPES; i++) {
+        pthread_mutex_destroy(&t->stripes[i]);
+    }
+    pthread_mutex_destroy(&t->resize_lock);
+    pthread_mutex_destroy(&t->reclaim_lock);
+    free(t);
+}
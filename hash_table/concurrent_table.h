@@ -0,0 +1,45 @@
+/* Concurrent hashtable interface
+ * Thread-safe variant of the hash_table.h interface, specialized for storing
+ * character arrays as the key and arrays of integers as the value.
+ *
+ * Writers (ctable_insert, ctable_delete) take one of a fixed set of striped
+ * locks, so writers of different stripes run in parallel. Readers never take
+ * a lock and never wait for writers. Memory unlinked by writers is reclaimed
+ * once no reader that could still see it is active. A resize moves the
+ * buckets into the new array a few at a time, as part of later inserts and
+ * deletes, so no writer waits for the whole table to be copied.
+ *
+ * Build with -pthread. */
+
+/* Handle to concurrent hash table data structure. */
+struct ctable;
+
+/* Initialise a concurrent hash table and return a pointer to it, returns NULL
+ * on failure. The capacity is rounded up to a power of two. Requires a load
+ * factor after which to resize and the hash function to be used. */
+struct ctable *ctable_init(unsigned long capacity,
+                           double max_load_factor,
+                           unsigned long (*hash_func)(const unsigned char *));
+
+/* Copies and inserts key into the table together with value. If the key is
+ * already present the value is appended to its values instead.
+ * Returns 0 if successful and 1 otherwise. */
+int ctable_insert(struct ctable *t, const char *key, int value);
+
+/* Copies at most 'max_values' of the values stored for key into 'values',
+ * in insertion order. Never blocks.
+ * Returns the total number of values stored for key, which can be larger
+ * than 'max_values', or -1 if the key is not present or an error occured. */
+long ctable_lookup(struct ctable *t, const char *key, int *values,
+                   unsigned long max_values);
+
+/* Returns the load factor of the table, -1.0 if an error occured. */
+double ctable_load_factor(const struct ctable *t);
+
+/* Remove the specified key and its values from the table.
+ * Returns 0 if the key was removed, 1 if the key was not present and -1 if
+ * an error occured. */
+int ctable_delete(struct ctable *t, const char *key);
+
+/* Clean up the table. No other thread may use the table anymore. */
+void ctable_cleanup(struct ctable *t);
@@ -0,0 +1,63 @@
+/*
+ * Implements the file helpers shared by frozen tables and the write-ahead
+ * log.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "file_io.h"
+
+typedef unsigned long longtype;
+
+int file_write_all(int fd, const void *data, unsigned long size) {
+    const char *p = data;
+    longtype left = size;
+
+    while (left > 0) {
+        ssize_t written = write(fd, p, left);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return 1;
+        }
+        p += written;
+        left -= (longtype)written;
+    }
+
+    return 0;
+}
+
+int file_sync_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *dir = ".";
+    char *copy = NULL;
+
+    if (slash == path) {
+        dir = "/";
+    } else if (slash != NULL) {
+        copy = malloc((longtype)(slash - path) + 1);
+        if (copy == NULL) {
+            return 1;
+        }
+        memcpy(copy, path, (longtype)(slash - path));
+        copy[slash - path] = '\0';
+        dir = copy;
+    }
+
+    int fd = open(dir, O_RDONLY);
+    free(copy);
+    if (fd < 0) {
+        return 1;
+    }
+
+    int result = fsync(fd) != 0;
+    close(fd);
+    return result;
+}
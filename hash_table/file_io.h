@@ -0,0 +1,13 @@
+/* File helper interface
+ * Small wrappers around POSIX file calls shared by the modules that write
+ * snapshot and log files. */
+
+/* Write all 'size' bytes at 'data' to the file descriptor 'fd', retrying
+ * short writes and writes interrupted by a signal.
+ * Returns 0 if successful and 1 otherwise. */
+int file_write_all(int fd, const void *data, unsigned long size);
+
+/* Sync the directory holding 'path', so a file created in it or renamed
+ * into it survives a crash.
+ * Returns 0 if successful and 1 otherwise. */
+int file_sync_dir(const char *path);
@@ -0,0 +1,734 @@
+/*
+ * Implements frozen hash tables. All data lives in one block that only uses
+ * offsets, never pointers:
+ *
+ *   header | displacements | slots | values | key bytes
+ *
+ * Keys are assigned to slots with CHD (compress, hash and displace): keys
+ * are hashed into small buckets, and for every bucket, largest first, a
+ * displacement pair (d0, d1) is searched that moves all of its keys to free
+ * slots. There are exactly as many slots as keys.
+ *
+ * Tables frozen with FREEZE_COMPRESS hold one packed posting list per key in
+ * the values section instead of plain integers, see posting.h.
+ *
+ * Because the block is position independent, frozen_save() writes it to a
+ * file unchanged and frozen_load() maps that file back into memory, after
+ * which lookups read straight from the mapped pages.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "array.h"
+#include "file_io.h"
+#include "frozen_table.h"
+#include "hash_func.h"
+#include "hash_table.h"
+#include "posting.h"
+
+#define FROZEN_MAGIC "FRZTBL1"
+
+/* Average number of keys per CHD bucket. Higher values need less space for
+ * displacements but take longer to build. */
+#define BUCKET_LOAD 4
+
+/* Limits of the displacement search, a new seed is tried when a bucket
+ * cannot be placed. */
+#define MAX_D0 256
+#define MAX_SEEDS 16
+
+/* Header flags: the table only stores counts, no values, or it stores the
+ * values of every key as a packed posting list. */
+#define FROZEN_COUNT_ONLY 1
+#define FROZEN_COMPRESSED 2
+
+/* Stored in the header to detect files written on a machine with a different
+ * byte order. */
+#define FROZEN_BYTE_ORDER 0x0102030405060708ULL
+
+typedef unsigned long longtype;
+
+struct frozen_header {
+    char magic[8];
+    uint64_t byte_order;
+    /* Size of the whole block in bytes */
+    uint64_t size;
+    uint64_t n_keys;
+    uint64_t n_buckets;
+    uint64_t seed;
+    uint64_t flags;
+    /* Offsets from the start of the block */
+    uint64_t disp_off;
+    uint64_t slots_off;
+    uint64_t values_off;
+    uint64_t keys_off;
+};
+
+struct frozen_disp {
+    uint32_t d0;
+    uint32_t d1;
+};
+
+struct frozen_slot {
+    /* Offset of the key in the key bytes */
+    uint64_t key_off;
+    /* Index of the first value in the values, or the offset in bytes of the
+     * packed posting list in compressed tables */
+    uint64_t value_index;
+    uint32_t key_len;
+    uint32_t value_count;
+};
+
+struct frozen_table {
+    const unsigned char *block;
+    unsigned long size;
+    /* 1 if block is a mapped file, 0 if it was allocated by table_freeze() */
+    int mapped;
+};
+
+/* A key collected from the source table while freezing. */
+struct entry {
+    const char *key;
+    unsigned long key_len;
+    const struct array *values;
+    uint64_t hash;
+    /* Slot function parameters derived from hash */
+    uint64_t f1;
+    uint64_t f2;
+};
+
+struct collector {
+    struct entry *entries;
+    longtype n;
+    longtype capacity;
+};
+
+static uint64_t fmix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Split the hash of a key into the two parameters of its slot function. */
+static void slot_params(uint64_t hash, uint64_t m, uint64_t *f1, uint64_t *f2) {
+    uint64_t g = fmix(hash);
+    *f1 = (g & 0xffffffffULL) % m;
+    *f2 = (g >> 32) % m;
+}
+
+/* Slot of a key in a table of m slots, for displacement d. */
+static uint64_t slot_of(uint64_t f1, uint64_t f2, struct frozen_disp d,
+                        uint64_t m) {
+    return (f1 + (uint64_t)d.d0 * f2 + d.d1) % m;
+}
+
+static uint64_t align8(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t)7;
+}
+
+static int collect(const char *key, unsigned long key_len,
+                   const struct array *values, void *ctx) {
+    struct collector *c = ctx;
+
+    if (c->n == c->capacity) {
+        longtype new_capacity = c->capacity * 2 + 16;
+        struct entry *grown = realloc(c->entries,
+                                      new_capacity * sizeof(struct entry));
+        if (grown == NULL) {
+            return 1;
+        }
+        c->entries = grown;
+        c->capacity = new_capacity;
+    }
+
+    c->entries[c->n].key = key;
+    c->entries[c->n].key_len = key_len;
+    c->entries[c->n].values = values;
+    c->n++;
+    return 0;
+}
+
+/* Search a displacement for every bucket. On success disp[b] holds the
+ * displacement of bucket b and slots[i] the slot of entry i.
+ * Returns 0 if successful, 1 if this seed does not work and -1 on failure. */
+static int place(struct entry *entries, longtype n, uint64_t seed,
+                 longtype n_buckets, struct frozen_disp *disp,
+                 uint64_t *slots) {
+    longtype *bucket_start = calloc(n_buckets + 1, sizeof(longtype));
+    longtype *order = malloc(n * sizeof(longtype));
+    longtype *by_size = malloc(n_buckets * sizeof(longtype));
+    longtype *size_start = calloc(n + 2, sizeof(longtype));
+    unsigned char *taken = calloc(n, 1);
+    int result = -1;
+
+    if (bucket_start == NULL || order == NULL || by_size == NULL
+        || size_start == NULL || taken == NULL) {
+        goto out;
+    }
+
+    /* Group the entries by bucket with a counting sort. */
+    for (longtype i = 0; i < n; i++) {
+        entries[i].hash = hash_wy_seed((const unsigned char *)entries[i].key,
+                                       entries[i].key_len, seed);
+        slot_params(entries[i].hash, n, &entries[i].f1, &entries[i].f2);
+        bucket_start[entries[i].hash % n_buckets + 1]++;
+    }
+    for (longtype b = 0; b < n_buckets; b++) {
+        bucket_start[b + 1] += bucket_start[b];
+    }
+    for (longtype i = 0; i < n; i++) {
+        order[bucket_start[entries[i].hash % n_buckets]++] = i;
+    }
+    /* bucket_start[b] now holds the end of bucket b, shift it back. */
+    memmove(bucket_start + 1, bucket_start, n_buckets * sizeof(longtype));
+    bucket_start[0] = 0;
+
+    /* Order the buckets by decreasing size, again with a counting sort. */
+    for (longtype b = 0; b < n_buckets; b++) {
+        size_start[n - (bucket_start[b + 1] - bucket_start[b]) + 1]++;
+    }
+    for (longtype k = 0; k <= n; k++) {
+        size_start[k + 1] += size_start[k];
+    }
+    for (longtype b = 0; b < n_buckets; b++) {
+        by_size[size_start[n - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+    }
+
+    /* Lowest slot that may still be free, used for single key buckets. */
+    longtype free_cursor = 0;
+
+    result = 0;
+    for (longtype i = 0; i < n_buckets && result == 0; i++) {
+        longtype b = by_size[i];
+        longtype first = bucket_start[b];
+        longtype count = bucket_start[b + 1] - first;
+        struct frozen_disp d = {0, 0};
+        int placed = 0;
+
+        disp[b] = d;
+        if (count == 0) {
+            continue;
+        }
+
+        /* Buckets are sorted by size, so from here on every bucket has a
+         * single key, which can be displaced straight into a free slot. */
+        if (count == 1) {
+            while (taken[free_cursor]) {
+                free_cursor++;
+            }
+
+            struct entry *e = &entries[order[first]];
+            d.d1 = (uint32_t)((free_cursor + n - e->f1) % n);
+            disp[b] = d;
+            slots[order[first]] = free_cursor;
+            taken[free_cursor] = 1;
+            continue;
+        }
+
+        for (d.d0 = 0; d.d0 < MAX_D0 && !placed; d.d0++) {
+            for (d.d1 = 0; d.d1 < n && !placed; d.d1++) {
+                longtype k;
+                for (k = 0; k < count; k++) {
+                    struct entry *e = &entries[order[first + k]];
+                    uint64_t s = slot_of(e->f1, e->f2, d, n);
+                    if (taken[s]) {
+                        break;
+                    }
+                    taken[s] = 1;
+                    slots[order[first + k]] = s;
+                }
+
+                if (k == count) {
+                    placed = 1;
+                    disp[b] = d;
+                } else {
+                    /* Undo the slots this attempt already claimed. */
+                    while (k-- > 0) {
+                        taken[slots[order[first + k]]] = 0;
+                    }
+                }
+            }
+        }
+
+        if (!placed) {
+            result = 1;
+        }
+    }
+
+out:
+    free(bucket_start);
+    free(order);
+    free(by_size);
+    free(size_start);
+    free(taken);
+    return result;
+}
+
+/* Free the first n posting lists of postings and the array itself. */
+static void postings_free(struct posting **postings, longtype n) {
+    if (postings == NULL) {
+        return;
+    }
+
+    for (longtype i = 0; i < n; i++) {
+        posting_cleanup(postings[i]);
+    }
+    free(postings);
+}
+
+struct frozen_table *table_freeze(const struct table *t) {
+    return table_freeze_flags(t, 0);
+}
+
+struct frozen_table *table_freeze_flags(const struct table *t,
+                                        unsigned int flags) {
+    if (t == NULL) {
+        return NULL;
+    }
+
+    struct collector c = {NULL, 0, 0};
+    if (table_foreach(t, collect, &c) != 0) {
+        free(c.entries);
+        return NULL;
+    }
+
+    longtype n = c.n;
+    longtype n_buckets = n / BUCKET_LOAD + 1;
+    struct frozen_disp *disp = malloc(n_buckets * sizeof(struct frozen_disp));
+    uint64_t *slots = malloc((n + 1) * sizeof(uint64_t));
+    struct frozen_table *f = malloc(sizeof(struct frozen_table));
+    unsigned char *block = NULL;
+    struct posting **postings = NULL;
+    longtype n_postings = 0;
+    uint64_t seed = 0;
+    int placed = n == 0 ? 0 : 1;
+
+    if (disp == NULL || slots == NULL || f == NULL) {
+        goto fail;
+    }
+
+    for (longtype attempt = 0; attempt < MAX_SEEDS && placed != 0; attempt++) {
+        seed = fmix(attempt + 1);
+        placed = place(c.entries, n, seed, n_buckets, disp, slots);
+        if (placed < 0) {
+            goto fail;
+        }
+    }
+    if (placed != 0) {
+        goto fail;
+    }
+    if (n == 0) {
+        disp[0].d0 = 0;
+        disp[0].d1 = 0;
+    }
+
+    /* A count-only table has no values to copy. */
+    int count_only = n > 0 && array_count_only(c.entries[0].values);
+    int compress = (flags & FREEZE_COMPRESS) && !count_only;
+    uint64_t values_bytes = 0;
+    uint64_t key_bytes = 0;
+
+    /* Compressed values are built up front, as their size is only known
+     * once they are packed. */
+    if (compress) {
+        postings = malloc((n + 1) * sizeof(struct posting *));
+        if (postings == NULL) {
+            goto fail;
+        }
+    }
+
+    for (longtype i = 0; i < n; i++) {
+        if (compress) {
+            postings[i] = posting_from_array(c.entries[i].values);
+            if (postings[i] == NULL) {
+                goto fail;
+            }
+            n_postings++;
+            values_bytes += posting_packed_size(postings[i]);
+        } else if (!count_only) {
+            values_bytes += array_size(c.entries[i].values) * sizeof(int);
+        }
+        key_bytes += c.entries[i].key_len + 1;
+    }
+
+    struct frozen_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, FROZEN_MAGIC, sizeof(h.magic));
+    h.byte_order = FROZEN_BYTE_ORDER;
+    h.n_keys = n;
+    h.n_buckets = n_buckets;
+    h.seed = seed;
+    h.flags = count_only ? FROZEN_COUNT_ONLY
+              : compress ? FROZEN_COMPRESSED
+                         : 0;
+    h.disp_off = align8(sizeof(h));
+    h.slots_off = align8(h.disp_off + n_buckets * sizeof(struct frozen_disp));
+    h.values_off = align8(h.slots_off + n * sizeof(struct frozen_slot));
+    h.keys_off = align8(h.values_off + values_bytes);
+    h.size = align8(h.keys_off + key_bytes);
+
+    block = calloc(1, h.size);
+    if (block == NULL) {
+        goto fail;
+    }
+
+    memcpy(block, &h, sizeof(h));
+    memcpy(block + h.disp_off, disp, n_buckets * sizeof(struct frozen_disp));
+
+    struct frozen_slot *out = (struct frozen_slot *)(block + h.slots_off);
+    int *values = (int *)(block + h.values_off);
+    char *keys = (char *)(block + h.keys_off);
+    uint64_t value_index = 0;
+    uint64_t packed_off = 0;
+    uint64_t key_off = 0;
+
+    for (longtype i = 0; i < n; i++) {
+        struct frozen_slot *s = &out[slots[i]];
+        const struct array *a = c.entries[i].values;
+        longtype size = array_size(a);
+
+        s->key_off = key_off;
+        s->key_len = (uint32_t)c.entries[i].key_len;
+        memcpy(keys + key_off, c.entries[i].key, c.entries[i].key_len);
+        key_off += c.entries[i].key_len + 1;
+
+        s->value_count = (uint32_t)size;
+        if (compress) {
+            s->value_index = packed_off;
+            posting_pack(postings[i], block + h.values_off + packed_off);
+            packed_off += posting_packed_size(postings[i]);
+            continue;
+        }
+
+        s->value_index = value_index;
+        if (!count_only) {
+            for (longtype j = 0; j < size; j++) {
+                values[value_index++] = array_get(a, j);
+            }
+        }
+    }
+
+    f->block = block;
+    f->size = h.size;
+    f->mapped = 0;
+
+    free(c.entries);
+    free(disp);
+    free(slots);
+    postings_free(postings, n_postings);
+    return f;
+
+fail:
+    free(c.entries);
+    free(disp);
+    free(slots);
+    postings_free(postings, n_postings);
+    free(f);
+    free(block);
+    return NULL;
+}
+
+long frozen_lookup(const struct frozen_table *f, const char *key,
+                   const int **values) {
+    if (key == NULL) {
+        return -1;
+    }
+
+    return frozen_lookup_n(f, key, strlen(key), values);
+}
+
+/* Returns the slot of key, or NULL if the key is not present. */
+static const struct frozen_slot *slot_find(const struct frozen_table *f,
+                                           const char *key,
+                                           unsigned long key_len) {
+    const struct frozen_header *h = (const struct frozen_header *)f->block;
+    if (h->n_keys == 0) {
+        return NULL;
+    }
+
+    uint64_t hash = hash_wy_seed((const unsigned char *)key, key_len, h->seed);
+    const struct frozen_disp *disp =
+        (const struct frozen_disp *)(f->block + h->disp_off);
+    uint64_t f1, f2;
+    slot_params(hash, h->n_keys, &f1, &f2);
+    uint64_t index = slot_of(f1, f2, disp[hash % h->n_buckets], h->n_keys);
+    const struct frozen_slot *s =
+        (const struct frozen_slot *)(f->block + h->slots_off) + index;
+
+    /* The perfect hash maps every key to some slot, so the key itself still
+     * has to be compared. */
+    if (s->key_len != key_len
+        || memcmp(f->block + h->keys_off + s->key_off, key, key_len) != 0) {
+        return NULL;
+    }
+
+    return s;
+}
+
+long frozen_lookup_n(const struct frozen_table *f, const char *key,
+                     unsigned long key_len, const int **values) {
+    if (f == NULL || key == NULL || values == NULL) {
+        return -1;
+    }
+
+    const struct frozen_slot *s = slot_find(f, key, key_len);
+    if (s == NULL) {
+        return -1;
+    }
+
+    const struct frozen_header *h = (const struct frozen_header *)f->block;
+    if (h->flags & (FROZEN_COUNT_ONLY | FROZEN_COMPRESSED)) {
+        *values = NULL;
+    } else {
+        *values = (const int *)(f->block + h->values_off) + s->value_index;
+    }
+
+    return (long)s->value_count;
+}
+
+long frozen_lookup_posting(const struct frozen_table *f, const char *key,
+                           unsigned long key_len, struct posting *values) {
+    if (f == NULL || key == NULL || values == NULL) {
+        return -1;
+    }
+
+    const struct frozen_header *h = (const struct frozen_header *)f->block;
+    const struct frozen_slot *s = slot_find(f, key, key_len);
+    if (!(h->flags & FROZEN_COMPRESSED) || s == NULL) {
+        return -1;
+    }
+
+    posting_view(values, f->block + h->values_off + s->value_index,
+                 s->value_count);
+    return (long)s->value_count;
+}
+
+int frozen_foreach(const struct frozen_table *f,
+                   int (*visit)(const char *key, unsigned long key_len,
+                                const int *values, unsigned long count,
+                                void *ctx),
+                   void *ctx) {
+    if (f == NULL || visit == NULL) {
+        return -1;
+    }
+
+    const struct frozen_header *h = (const struct frozen_header *)f->block;
+    const struct frozen_slot *slots =
+        (const struct frozen_slot *)(f->block + h->slots_off);
+    const int *values = (const int *)(f->block + h->values_off);
+    const char *keys = (const char *)(f->block + h->keys_off);
+    int result = 0;
+
+    for (uint64_t i = 0; i < h->n_keys && result == 0; i++) {
+        const struct frozen_slot *s = &slots[i];
+        const int *v = h->flags & (FROZEN_COUNT_ONLY | FROZEN_COMPRESSED)
+                           ? NULL
+                           : values + s->value_index;
+        result = visit(keys + s->key_off, s->key_len, v, s->value_count, ctx);
+    }
+
+    return result;
+}
+
+unsigned long frozen_checksum(const struct frozen_table *f) {
+    if (f == NULL) {
+        return 0;
+    }
+
+    return hash_wy_seed(f->block, f->size, FROZEN_BYTE_ORDER);
+}
+
+unsigned long frozen_size(const struct frozen_table *f) {
+    if (f == NULL) {
+        return 0;
+    }
+
+    return ((const struct frozen_header *)f->block)->n_keys;
+}
+
+unsigned long frozen_footprint(const struct frozen_table *f) {
+    if (f == NULL) {
+        return 0;
+    }
+
+    return sizeof(struct frozen_table) + f->size;
+}
+
+int frozen_save(const struct frozen_table *f, const char *path) {
+    if (f == NULL || path == NULL) {
+        return 1;
+    }
+
+    /* Write to a temporary file first, so a crash never leaves a truncated
+     * snapshot behind under the final name. */
+    size_t path_len = strlen(path);
+    char *tmp_path = malloc(path_len + sizeof(".tmp"));
+    if (tmp_path == NULL) {
+        return 1;
+    }
+    memcpy(tmp_path, path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp_path);
+        return 1;
+    }
+
+    /* The descriptor is closed whatever happened, close() can report a
+     * failed write as well. */
+    int failed = file_write_all(fd, f->block, f->size) != 0
+                 || fsync(fd) != 0;
+    failed = close(fd) != 0 || failed;
+    if (failed || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return 1;
+    }
+    free(tmp_path);
+
+    return file_sync_dir(path) != 0 ? 2 : 0;
+}
+
+/* Returns 1 if 'count' items of 'item_size' bytes fit between the 8-byte
+ * aligned offset 'off' and 'end', 0 otherwise. Divides instead of
+ * multiplying, so counts read from a corrupt file cannot overflow. */
+static int section_fits(uint64_t off, uint64_t count, uint64_t item_size,
+                        uint64_t end) {
+    return off % 8 == 0 && off <= end && count <= (end - off) / item_size;
+}
+
+/* Check that a mapped block is a frozen table of exactly 'size' bytes whose
+ * sections lie within the block in order.
+ * Returns 0 if the header is valid and 1 otherwise. */
+static int header_check(const struct frozen_header *h, unsigned long size) {
+    if (size < sizeof(struct frozen_header)
+        || memcmp(h->magic, FROZEN_MAGIC, sizeof(h->magic)) != 0
+        || h->byte_order != FROZEN_BYTE_ORDER || h->size != size
+        || h->n_buckets == 0) {
+        return 1;
+    }
+
+    if (h->disp_off < sizeof(struct frozen_header)
+        || !section_fits(h->disp_off, h->n_buckets, sizeof(struct frozen_disp),
+                         h->slots_off)
+        || !section_fits(h->slots_off, h->n_keys, sizeof(struct frozen_slot),
+                         h->values_off)
+        || !section_fits(h->values_off, 0, sizeof(int), h->keys_off)
+        || h->keys_off > h->size) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Check that the key and values of every slot lie within their sections and
+ * that every key is NUL-terminated, so lookups never read outside a mapped
+ * file. Reads the slots, one byte per key and the skip entries of packed
+ * posting lists, but no values.
+ * Returns 0 if all slots are valid and 1 otherwise. */
+static int slots_check(const unsigned char *block) {
+    const struct frozen_header *h = (const struct frozen_header *)block;
+    const struct frozen_slot *slots =
+        (const struct frozen_slot *)(block + h->slots_off);
+    const char *keys = (const char *)(block + h->keys_off);
+    uint64_t key_bytes = h->size - h->keys_off;
+    uint64_t values_bytes = h->keys_off - h->values_off;
+    uint64_t n_values = values_bytes / sizeof(int);
+
+    for (uint64_t i = 0; i < h->n_keys; i++) {
+        const struct frozen_slot *s = &slots[i];
+        if (s->key_off >= key_bytes || s->key_len >= key_bytes - s->key_off
+            || keys[s->key_off + s->key_len] != '\0') {
+            return 1;
+        }
+
+        if (h->flags & FROZEN_COMPRESSED) {
+            if (s->value_index % 8 != 0 || s->value_index > values_bytes
+                || posting_packed_check(block + h->values_off + s->value_index,
+                                        values_bytes - s->value_index,
+                                        s->value_count) != 0) {
+                return 1;
+            }
+        } else if (!(h->flags & FROZEN_COUNT_ONLY)
+                   && (s->value_index > n_values
+                       || s->value_count > n_values - s->value_index)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+struct frozen_table *frozen_load(const char *path) {
+    if (path == NULL) {
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct frozen_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    unsigned long size = (unsigned long)st.st_size;
+    void *block = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (block == MAP_FAILED) {
+        return NULL;
+    }
+
+    struct frozen_table *f = malloc(sizeof(struct frozen_table));
+    if (f == NULL || header_check(block, size) != 0
+        || slots_check(block) != 0) {
+        munmap(block, size);
+        free(f);
+        return NULL;
+    }
+
+    f->block = block;
+    f->size = size;
+    f->mapped = 1;
+    return f;
+}
+
+int table_snapshot(const struct table *t, const char *path) {
+    struct frozen_table *f = table_freeze(t);
+    if (f == NULL) {
+        return 1;
+    }
+
+    int result = frozen_save(f, path);
+    frozen_cleanup(f);
+    return result;
+}
+
+void frozen_cleanup(struct frozen_table *f) {
+    if (f == NULL) {
+        return;
+    }
+
+    if (f->mapped) {
+        munmap((void *)f->block, f->size);
+    } else {
+        free((void *)f->block);
+    }
+    free(f);
+}
@@ -0,0 +1,102 @@
+/* Frozen hashtable interface
+ * Immutable, compact copy of a struct table for read-only dictionaries.
+ * Keys are placed with a minimal perfect hash function (CHD), so a lookup
+ * takes one hash, one slot access and one key comparison. Frozen tables can
+ * be saved to and memory-mapped from snapshot files. */
+
+struct table;
+struct posting;
+
+/* Handle to frozen hash table data structure. */
+struct frozen_table;
+
+/* Build a frozen copy of table 't', which is left unchanged. Keys and values
+ * are stored in one contiguous block.
+ * Returns NULL on failure. */
+struct frozen_table *table_freeze(const struct table *t);
+
+/* Flags for table_freeze_flags().
+ * FREEZE_COMPRESS: store the values of every key as a packed posting list
+ * (see posting.h), delta encoded and bit-packed, instead of as plain
+ * integers. Every key's values must be non-decreasing and non-negative,
+ * such as line or document numbers. Read them with frozen_lookup_posting().
+ * Has no effect on tables created with TABLE_COUNT_ONLY. */
+#define FREEZE_COMPRESS 1
+
+/* Same as table_freeze(), with a bitwise or of FREEZE_* flags.
+ * Returns NULL on failure, or if FREEZE_COMPRESS is given and the values of
+ * a key are not a non-decreasing sequence of non-negative integers. */
+struct frozen_table *table_freeze_flags(const struct table *t,
+                                        unsigned int flags);
+
+/* Look up key. On success '*values' points to the values of key, which stay
+ * valid until the frozen table is cleaned up. '*values' is set to NULL for
+ * tables that were created with TABLE_COUNT_ONLY or frozen with
+ * FREEZE_COMPRESS.
+ * Returns the number of values of key, or -1 if the key is not present or an
+ * error occured. */
+long frozen_lookup(const struct frozen_table *f, const char *key,
+                   const int **values);
+
+/* Same as frozen_lookup(), for binary keys of key_len bytes, as
+ * table_lookup_n() is for table_lookup(). The values live in the block of
+ * the frozen table rather than in struct arrays, so they are returned as a
+ * plain array and a count instead of a struct array. */
+long frozen_lookup_n(const struct frozen_table *f, const char *key,
+                     unsigned long key_len, const int **values);
+
+/* Look up key, of key_len bytes, in a table frozen with FREEZE_COMPRESS and
+ * initialise '*values' as a view of its compressed values, see
+ * posting_view(). The view reads the block of the frozen table in place and
+ * stays valid until the frozen table is cleaned up.
+ * Returns the number of values of key, or -1 if the key is not present, the
+ * table does not store compressed values or an error occured. */
+long frozen_lookup_posting(const struct frozen_table *f, const char *key,
+                           unsigned long key_len, struct posting *values);
+
+/* Calls visit for every key in the frozen table, in slot order, with the
+ * key, its length, its values and the number of values. Keys are
+ * NUL-terminated, values is NULL for tables that were created with
+ * TABLE_COUNT_ONLY or frozen with FREEZE_COMPRESS. Stops as soon as visit
+ * returns nonzero.
+ * Returns the last result of visit, or -1 if an error occured. */
+int frozen_foreach(const struct frozen_table *f,
+                   int (*visit)(const char *key, unsigned long key_len,
+                                const int *values, unsigned long count,
+                                void *ctx),
+                   void *ctx);
+
+/* Returns a 64-bit hash of the whole block, which identifies the contents of
+ * a snapshot. Reads every page of a mapped file. */
+unsigned long frozen_checksum(const struct frozen_table *f);
+
+/* Returns the number of keys in the frozen table. */
+unsigned long frozen_size(const struct frozen_table *f);
+
+/* Returns the number of bytes used by the frozen table. */
+unsigned long frozen_footprint(const struct frozen_table *f);
+
+/* Write the frozen table to the file at 'path', replacing it atomically and
+ * durably: the data and the directory entry are synced before returning.
+ * The file holds the block exactly as it is laid out in memory, so it can
+ * only be loaded on machines with the same byte order.
+ * Returns 0 if successful, 1 if the file at 'path' was left as it was and 2
+ * if it was replaced but the directory could not be synced, so a crash may
+ * still bring back the old file. */
+int frozen_save(const struct frozen_table *f, const char *path);
+
+/* Map a file written by frozen_save() or table_snapshot() into memory and
+ * return a frozen table that answers lookups straight from the mapped pages,
+ * without converting the file first. Loading checks that every offset in the
+ * file lies within it, which reads the slots and one byte of every key. The
+ * file must not be modified while it is mapped. Returns NULL on failure or if
+ * the file is not a frozen table. */
+struct frozen_table *frozen_load(const char *path);
+
+/* Freeze table 't' and write it to the file at 'path', see frozen_save().
+ * Returns 0 if successful, 1 if the file was left as it was and 2 if it was
+ * replaced but not durably. */
+int table_snapshot(const struct table *t, const char *path);
+
+/* Clean up the frozen table. */
+void frozen_cleanup(struct frozen_table *f);
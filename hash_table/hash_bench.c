@@ -0,0 +1,336 @@
+/*
+ * Benchmark and quality analysis for the hash functions in hash_func.c.
+ *
+ * Every hash function is run over a corpus of keys. For each function this
+ * reports the hashing throughput, the bucket occupancy and chain length
+ * histogram of a live struct table filled with the corpus, the longest
+ * chain, and the mean table_lookup latency for keys that are present. The
+ * tables are created with TABLE_NO_RESEED, so a weak hash function shows up
+ * in its chains instead of being replaced by a re-key.
+ *
+ * Build:
+ *   gcc -O2 -o hash_bench hash_bench.c hash_table.c hash_table_flat.c \
+ *       hash_func.c array.c arena.c bloom.c interner.c -lm
+ *
+ * Usage: hash_bench [-c corpus] [-f file] [-n keys] [-b bins] [-F]
+ *   -c  words, urls, seq or adversarial (default words)
+ *   -f  read the corpus from a file, one key per line
+ *   -n  number of keys (default 100000)
+ *   -b  number of histogram bins (default 8)
+ *   -F  use TABLE_FLAT tables, the histogram then shows probe distances
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "array.h"
+#include "hash_func.h"
+#include "hash_table.h"
+
+#define DEFAULT_KEYS 100000
+#define DEFAULT_BINS 8
+
+/* Hashing is repeated until at least this many bytes have been hashed, to
+ * get a stable throughput figure for small corpora. */
+#define MIN_HASH_BYTES (256UL << 20)
+
+/* Initial capacity of the analysed tables, they grow as usual. */
+#define TABLE_CAPACITY 1024
+#define TABLE_LOAD 0.75
+
+struct hash_entry {
+    const char *name;
+    unsigned long (*hash_func)(const unsigned char *);
+    unsigned long (*hash_len_func)(const unsigned char *, unsigned long);
+};
+
+static const struct hash_entry hashes[] = {
+    {"too_simple", hash_too_simple, NULL},
+    {"djb2", hash_djb2, NULL},
+    {"multiplication", hash_multiplication, NULL},
+    {"original", hash_original, NULL},
+    {"wy_str", hash_wy_str, NULL},
+    {"wy (len)", NULL, hash_wy},
+};
+
+struct corpus {
+    char **keys;
+    unsigned long *lens;
+    unsigned long n;
+    unsigned long bytes;
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int corpus_add(struct corpus *c, const char *key, unsigned long cap) {
+    if (c->n == cap) {
+        return 1;
+    }
+
+    c->lens[c->n] = strlen(key);
+    c->keys[c->n] = malloc(c->lens[c->n] + 1);
+    if (c->keys[c->n] == NULL) {
+        return 1;
+    }
+
+    memcpy(c->keys[c->n], key, c->lens[c->n] + 1);
+    c->bytes += c->lens[c->n];
+    c->n++;
+    return 0;
+}
+
+/* Cheap xorshift generator, so corpora are the same on every run. */
+static unsigned long next_random(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Pronounceable pseudo words of 2 to 12 letters, used when no dictionary
+ * file is available. */
+static void make_word(char *buf, unsigned long *state) {
+    static const char consonants[] = "bcdfghjklmnprstvwz";
+    static const char vowels[] = "aeiou";
+    unsigned long len = 2 + next_random(state) % 11;
+
+    for (unsigned long i = 0; i < len; i++) {
+        if (i % 2 == 0) {
+            buf[i] = consonants[next_random(state) % (sizeof(consonants) - 1)];
+        } else {
+            buf[i] = vowels[next_random(state) % (sizeof(vowels) - 1)];
+        }
+    }
+    buf[len] = '\0';
+}
+
+/* Keys that collide for djb2: "az" and "bY" hash equally (33 * 1 == 'z' -
+ * 'Y'), so every string built from n such blocks is one of 2^n colliding
+ * keys. They also all share their first character for hash_too_simple. */
+static void make_adversarial(char *buf, unsigned long i) {
+    unsigned long pos = 0;
+    for (int block = 0; block < 20; block++) {
+        if (i & (1UL << block)) {
+            buf[pos++] = 'b';
+            buf[pos++] = 'Y';
+        } else {
+            buf[pos++] = 'a';
+            buf[pos++] = 'z';
+        }
+    }
+    buf[pos] = '\0';
+}
+
+/* Build a corpus of n keys. Duplicate keys are allowed, they only end up in
+ * the same node. Returns 0 if successful and 1 otherwise. */
+static int corpus_init(struct corpus *c, const char *kind, const char *path,
+                       unsigned long n) {
+    char buf[256];
+    unsigned long state = 0x2545f4914f6cdd1dUL;
+
+    c->keys = malloc(n * sizeof(char *));
+    c->lens = malloc(n * sizeof(unsigned long));
+    c->n = 0;
+    c->bytes = 0;
+    if (c->keys == NULL || c->lens == NULL) {
+        return 1;
+    }
+
+    if (path != NULL) {
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+            perror(path);
+            return 1;
+        }
+
+        while (c->n < n && fgets(buf, sizeof(buf), fp) != NULL) {
+            buf[strcspn(buf, "\r\n")] = '\0';
+            if (buf[0] != '\0' && corpus_add(c, buf, n) != 0) {
+                fclose(fp);
+                return 1;
+            }
+        }
+
+        fclose(fp);
+        return c->n == 0;
+    }
+
+    for (unsigned long i = 0; i < n; i++) {
+        if (strcmp(kind, "words") == 0) {
+            make_word(buf, &state);
+        } else if (strcmp(kind, "urls") == 0) {
+            snprintf(buf, sizeof(buf),
+                     "https://www.example.com/catalog/%lu/item.html?id=%lu",
+                     next_random(&state) % 1000, i);
+        } else if (strcmp(kind, "seq") == 0) {
+            snprintf(buf, sizeof(buf), "%010lu", i);
+        } else if (strcmp(kind, "adversarial") == 0) {
+            make_adversarial(buf, i);
+        } else {
+            fprintf(stderr, "unknown corpus '%s'\n", kind);
+            return 1;
+        }
+
+        if (corpus_add(c, buf, n) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void corpus_cleanup(struct corpus *c) {
+    for (unsigned long i = 0; i < c->n; i++) {
+        free(c->keys[i]);
+    }
+    free(c->keys);
+    free(c->lens);
+}
+
+/* Returns the hashing throughput of h over the corpus in GB/s. */
+static double hash_throughput(const struct hash_entry *h,
+                              const struct corpus *c) {
+    unsigned long rounds = MIN_HASH_BYTES / (c->bytes + 1) + 1;
+    volatile unsigned long sink = 0;
+    unsigned long acc = 0;
+
+    double start = now();
+    for (unsigned long r = 0; r < rounds; r++) {
+        for (unsigned long i = 0; i < c->n; i++) {
+            const unsigned char *key = (const unsigned char *)c->keys[i];
+            acc += h->hash_func != NULL ? h->hash_func(key)
+                                        : h->hash_len_func(key, c->lens[i]);
+        }
+    }
+    double elapsed = now() - start;
+    sink = acc;
+    (void)sink;
+
+    return (double)(c->bytes * rounds) / elapsed / 1e9;
+}
+
+static int analyse(const struct hash_entry *h, const struct corpus *c,
+                   unsigned int flags, unsigned long bins) {
+    struct table *t = h->hash_func != NULL
+                          ? table_init_flags(TABLE_CAPACITY, TABLE_LOAD,
+                                             h->hash_func,
+                                             flags | TABLE_NO_RESEED)
+                          : table_init_len(TABLE_CAPACITY, TABLE_LOAD,
+                                           h->hash_len_func,
+                                           flags | TABLE_NO_RESEED);
+    unsigned long *histogram = malloc(bins * sizeof(unsigned long));
+    if (t == NULL || histogram == NULL) {
+        table_cleanup(t);
+        free(histogram);
+        return 1;
+    }
+
+    double throughput = hash_throughput(h, c);
+
+    double start = now();
+    for (unsigned long i = 0; i < c->n; i++) {
+        if (table_insert(t, c->keys[i], (int)i) != 0) {
+            table_cleanup(t);
+            free(histogram);
+            return 1;
+        }
+    }
+    double insert_ns = (now() - start) * 1e9 / (double)c->n;
+
+    /* Look the keys up in a scattered order, so consecutive lookups do not
+     * hit the same cache lines. */
+    unsigned long stride = 7919;
+    while (c->n % stride == 0 && stride > 1) {
+        stride--;
+    }
+    start = now();
+    for (unsigned long i = 0, k = 0; i < c->n; i++, k = (k + stride) % c->n) {
+        if (table_lookup(t, c->keys[k]) == NULL) {
+            fprintf(stderr, "%s: lost key '%s'\n", h->name, c->keys[k]);
+        }
+    }
+    double lookup_ns = (now() - start) * 1e9 / (double)c->n;
+
+    long longest = table_chain_histogram(t, histogram, bins);
+
+    printf("%-15s %8.3f %10.1f %10.1f %8.3f %8ld  ", h->name, throughput,
+           insert_ns, lookup_ns, table_load_factor(t), longest);
+    for (unsigned long i = 0; i < bins; i++) {
+        printf(" %lu", histogram[i]);
+    }
+    printf("\n");
+
+    free(histogram);
+    table_cleanup(t);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *kind = "words";
+    const char *path = NULL;
+    unsigned long n = DEFAULT_KEYS;
+    unsigned long bins = DEFAULT_BINS;
+    unsigned int flags = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:f:n:b:F")) != -1) {
+        switch (opt) {
+        case 'c':
+            kind = optarg;
+            break;
+        case 'f':
+            path = optarg;
+            break;
+        case 'n':
+            n = strtoul(optarg, NULL, 10);
+            break;
+        case 'b':
+            bins = strtoul(optarg, NULL, 10);
+            break;
+        case 'F':
+            flags |= TABLE_FLAT;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-c words|urls|seq|adversarial] "
+                            "[-f file] [-n keys] [-b bins] [-F]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (n == 0 || bins == 0) {
+        fprintf(stderr, "keys and bins must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    struct corpus c;
+    if (corpus_init(&c, kind, path, n) != 0) {
+        fprintf(stderr, "could not build corpus\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("corpus %s: %lu keys, %lu bytes, %s engine\n",
+           path != NULL ? path : kind, c.n, c.bytes,
+           flags & TABLE_FLAT ? "flat" : "chaining");
+    printf("%-15s %8s %10s %10s %8s %8s   %s\n", "hash", "GB/s",
+           "insert ns", "lookup ns", "load", "longest",
+           flags & TABLE_FLAT ? "probe distance histogram"
+                              : "chain length histogram");
+
+    for (unsigned long i = 0; i < sizeof(hashes) / sizeof(hashes[0]); i++) {
+        if (analyse(&hashes[i], &c, flags, bins) != 0) {
+            fprintf(stderr, "%s: analysis failed\n", hashes[i].name);
+        }
+    }
+
+    corpus_cleanup(&c);
+    return EXIT_SUCCESS;
+}
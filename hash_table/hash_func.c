@@ -4,9 +4,18 @@
 
     This file consists of all the hash functions.
 */
+#include <stdint.h>
+#include <string.h>
+
 #include "limits.h"
 #include "hash_func.h"
 
+/* Secret constants of wyhash. */
+#define WY_S0 UINT64_C(0xa0761d6478bd642f)
+#define WY_S1 UINT64_C(0xe7037ed1a0b428db)
+#define WY_S2 UINT64_C(0x8ebc6af09c88c6e3)
+#define WY_S3 UINT64_C(0x589965cc75374cc3)
+
 
 /* Do not edit this function, as it used in testing too
  * Add you own hash functions with different headers instead. */
@@ -57,3 +66,104 @@ unsigned long hash_original(const unsigned char *str) {
 
     return hash;
 }
+
+/* Multiply a and b to 128 bits, store the low half in a and the high half
+ * in b. */
+static void wy_mum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)*a * *b;
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = (uint32_t)*a, lb = (uint32_t)*b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t wy_mix(uint64_t a, uint64_t b) {
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+/* Unaligned little-endian reads, memcpy compiles to a single load. */
+static uint64_t wy_read8(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint64_t wy_read4(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* Reads 1 to 3 bytes. */
+static uint64_t wy_read3(const unsigned char *p, unsigned long len) {
+    return ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8)
+           | p[len - 1];
+}
+
+/* The state is 64 bits wide whatever the width of unsigned long, only the
+ * result is narrowed to it. */
+unsigned long hash_wy_seed(const unsigned char *str, unsigned long len,
+                           unsigned long seed) {
+    const unsigned char *p = str;
+    uint64_t s = seed;
+    uint64_t a, b;
+
+    s ^= wy_mix(s ^ WY_S0, WY_S1);
+
+    if (len <= 16) {
+        if (len >= 4) {
+            unsigned long shift = (len >> 3) << 2;
+            a = (wy_read4(p) << 32) | wy_read4(p + shift);
+            b = (wy_read4(p + len - 4) << 32) | wy_read4(p + len - 4 - shift);
+        } else if (len > 0) {
+            a = wy_read3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        unsigned long i = len;
+        if (i > 48) {
+            uint64_t see1 = s, see2 = s;
+            do {
+                s = wy_mix(wy_read8(p) ^ WY_S1, wy_read8(p + 8) ^ s);
+                see1 = wy_mix(wy_read8(p + 16) ^ WY_S2, wy_read8(p + 24) ^ see1);
+                see2 = wy_mix(wy_read8(p + 32) ^ WY_S3, wy_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            s ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            s = wy_mix(wy_read8(p) ^ WY_S1, wy_read8(p + 8) ^ s);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_read8(p + i - 16);
+        b = wy_read8(p + i - 8);
+    }
+
+    a ^= WY_S1;
+    b ^= s;
+    wy_mum(&a, &b);
+    return (unsigned long)wy_mix(a ^ WY_S0 ^ len, b ^ WY_S1);
+}
+
+unsigned long hash_wy(const unsigned char *str, unsigned long len) {
+    return hash_wy_seed(str, len, 0);
+}
+
+unsigned long hash_wy_str(const unsigned char *str) {
+    return hash_wy_seed(str, strlen((const char *)str), 0);
+}
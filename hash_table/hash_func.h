@@ -14,3 +14,16 @@ unsigned long hash_multiplication(const unsigned char *str);
 /* A hash function for strings. It mixes each character into the hash
  * by rotating and blending with arithmetic operations. */
 unsigned long hash_original(const unsigned char *str);
+
+/* wyhash-style 64-bit hash over an explicit length. Reads the key 8 bytes at
+ * a time and mixes 48 bytes per loop step with 64x64->128 bit multiplies.
+ * Source: https://github.com/wangyi-fudan/wyhash */
+unsigned long hash_wy(const unsigned char *str, unsigned long len);
+
+/* hash_wy() with a caller-chosen seed, different seeds give independent
+ * hash functions. */
+unsigned long hash_wy_seed(const unsigned char *str, unsigned long len,
+                           unsigned long seed);
+
+/* hash_wy() for NUL-terminated strings, for use with table_init(). */
+unsigned long hash_wy_str(const unsigned char *str);
@@ -12,12 +12,39 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <time.h>
 
+#include "arena.h"
 #include "array.h"
+#include "bloom.h"
 #include "hash_table.h"
 #include "hash_func.h"
+#include "hash_table_flat.h"
+#include "interner.h"
 
-#define ARRAY_SIZE 100
+/* Number of keys the batch functions hash and prefetch ahead, before any of
+ * their chains are walked. */
+#define BATCH_SIZE 16
+
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+/* During an incremental resize, the number of empty old buckets a single
+ * step may skip over for every node it is allowed to move. */
+#define REHASH_EMPTY_VISITS 10
+
+/* An insert that walks more nodes than this, plus a few per unit of the
+ * maximum load factor, re-keys the table with a random seed. With a decent
+ * hash function chains this long practically never occur by chance. */
+#define CHAIN_LIMIT 16
+
+/* Keys shorter than this are copied to the stack when a hash function
+ * without a length argument needs them NUL-terminated. */
+#define KEY_COPY_SIZE 256
 
 typedef unsigned long longtype;
 struct table {
@@ -25,12 +52,58 @@ struct table {
     struct node **array;
     /* The function used for computing the hash values in this table */
     unsigned long (*hash_func)(const unsigned char *);
+    /* Length-aware hash function, used instead of hash_func if not NULL */
+    unsigned long (*hash_len_func)(const unsigned char *, unsigned long);
     /* Maximum load factor after which the table array should be resized */
     double max_load_factor;
+    /* Load factor below which a delete halves the table array, 0 if the
+     * array never shrinks */
+    double min_load_factor;
+    /* Capacity the table was created with, it never shrinks below this */
+    unsigned long min_capacity;
     /* Capacity of the array used to index the table */
     unsigned long capacity;
     /* Current number of elements stored in the table */
     unsigned long load;
+    /* Flat open addressing engine, NULL if the table uses chaining */
+    struct flat_table *flat;
+    /* Bucket array that is being migrated by an incremental resize, NULL if
+     * no resize is in progress */
+    struct node **old_array;
+    /* Capacity of old_array */
+    unsigned long old_capacity;
+    /* Buckets of old_array below this index have been migrated */
+    unsigned long rehash_index;
+    /* Maximum number of nodes moved per operation during an incremental
+     * resize, 0 if tables resize synchronously */
+    unsigned long rehash_step;
+    /* Arena that nodes and keys are allocated from, NULL if they are
+     * allocated with malloc */
+    struct arena *arena;
+    /* Deleted nodes of an arena table, reused by node_init() */
+    struct node *free_nodes;
+    /* TABLE_* flags the table was created with */
+    unsigned int flags;
+    /* Bloom filter holding the hash of every key, NULL if disabled */
+    struct bloom *bloom;
+    /* Filter sized for the new capacity, filled while an incremental resize
+     * migrates nodes and swapped in when it finishes. New keys are added to
+     * both filters. NULL if no resize is running or it could not be
+     * allocated, the old filter then stays in use. */
+    struct bloom *next_bloom;
+    /* Bits per key of the filters */
+    unsigned long bloom_bits;
+    /* Keys deleted since the filter was built, their bits are still set */
+    unsigned long bloom_stale;
+    /* Nonzero once the table has been re-keyed, all keys are then hashed
+     * with hash_wy_seed() and seed instead of the hash function */
+    int seeded;
+    unsigned long seed;
+    /* Capacity at the last re-key, the table is re-keyed at most once per
+     * capacity */
+    unsigned long seed_capacity;
+    /* Interner that owns the key bytes, NULL if the table copies keys */
+    struct interner *interner;
 };
 
 /* Note: This struct should be a *strong* hint to a specific type of hash table
@@ -39,18 +112,160 @@ struct table {
 struct node {
     /* The string of characters that is the key for this node */
     char *key;
-    /* A resizing array, containing the all the integer values for this key */
-    struct array *value;
+    /* Length of the key, without the terminating NUL */
+    unsigned long key_len;
+    /* Full hash value of the key, so resizing never has to rehash */
+    unsigned long hash;
+    /* A resizing array, containing the all the integer values for this key.
+     * The first few values are stored inside the node itself. */
+    struct array value;
     /* Next pointer */
     struct node *next;
 };
 
-/* Missing comment */
+/* Double the capacity of the table and redistribute all nodes over the new
+ * array, using the hash stored in each node.
+ * Returns 0 if successful and -1 otherwise. */
 int resize_and_rehash(struct table *t);
 
+/* Redistribute all nodes over a new array of new_capacity buckets.
+ * Returns 0 if successful and -1 otherwise. */
+static int rehash_to(struct table *t, longtype new_capacity);
+
+/* Start an incremental resize to new_capacity: the current bucket array
+ * becomes the old array and is migrated by later calls to rehash_step().
+ * Returns 0 if successful and -1 otherwise. */
+static int rehash_start(struct table *t, longtype new_capacity);
+
+/* Migrate at most t->rehash_step nodes from the old to the new bucket array,
+ * skipping at most REHASH_EMPTY_VISITS empty buckets per node. Finishes the
+ * resize when the old array has been emptied. */
+static void rehash_step(struct table *t);
+
+/* Move all remaining nodes of a running incremental resize. */
+static void rehash_finish(struct table *t);
+
+/* Re-key the table: rehash every key with hash_wy_seed() and a new random
+ * seed into a new bucket array of the same capacity. Used when a chain grows
+ * too long, because of a weak hash function or keys chosen to collide.
+ * Finishes a running incremental resize first, the one place where a single
+ * operation does unbounded work on an incrementally resizing table. Re-keys
+ * happen at most once per capacity, so the cost stays amortised.
+ * Returns 0 if successful and -1 otherwise. */
+static int table_reseed(struct table *t);
+
+/* Replace the Bloom filter with one sized for the current capacity, holding
+ * only the keys in the table. Keeps the old filter, which is still correct,
+ * if the new one cannot be allocated. */
+static void bloom_rebuild(struct table *t);
+
+/* Allocate and initialise a table for table_init_flags() and
+ * table_init_len(). Exactly one of the hash functions is not NULL. */
+static struct table *table_create(unsigned long capacity,
+                                  double max_load_factor,
+                                  unsigned long (*hash_func)(const unsigned char *),
+                                  unsigned long (*hash_len_func)(const unsigned char *,
+                                                                 unsigned long),
+                                  unsigned int flags);
+
+/* Hash a key of key_len bytes with the hash function of the table. */
+static longtype table_hash(const struct table *t, const char *key,
+                           longtype key_len) {
+    if (t->seeded) {
+        return hash_wy_seed((const unsigned char *)key, key_len, t->seed);
+    }
+
+    if (t->hash_len_func != NULL) {
+        return t->hash_len_func((const unsigned char *)key, key_len);
+    }
+
+    return t->hash_func((const unsigned char *)key);
+}
+
+/* Hash a key of key_len bytes that does not have to be NUL-terminated.
+ * Hash functions without a length argument read up to a NUL, so they are
+ * passed a terminated copy. Returns 0 if successful and 1 otherwise. */
+static int table_hash_n(const struct table *t, const char *key,
+                        longtype key_len, longtype *hash) {
+    if (t->seeded || t->hash_len_func != NULL) {
+        *hash = table_hash(t, key, key_len);
+        return 0;
+    }
+
+    char small[KEY_COPY_SIZE];
+    char *copy = key_len < KEY_COPY_SIZE ? small : malloc(key_len + 1);
+    if (copy == NULL) {
+        return 1;
+    }
+
+    memcpy(copy, key, key_len);
+    copy[key_len] = '\0';
+    *hash = t->hash_func((const unsigned char *)copy);
+    if (copy != small) {
+        free(copy);
+    }
+
+    return 0;
+}
+
+/* table_upsert() and table_lookup() for keys that have already been hashed,
+ * used by the batch functions. */
+static struct array *upsert_hashed(struct table *t, const char *key,
+                                   longtype key_len, longtype hash);
+static struct array *lookup_hashed(const struct table *t, const char *key,
+                                   longtype key_len, longtype hash);
+static int delete_hashed(struct table *t, const char *key, longtype key_len,
+                         longtype hash);
+
+/* Returns 1 if node holds the key with the given hash and length. Hash and
+ * length are checked first, so strings are only compared on a likely hit.
+ * Keys interned by the table's interner match by pointer. */
+static int node_matches(const struct node *n, const char *key,
+                        unsigned long key_len, unsigned long hash) {
+    if (n->key == key) {
+        return n->key_len == key_len;
+    }
+
+    return n->hash == hash && n->key_len == key_len
+           && memcmp(n->key, key, key_len) == 0;
+}
+
 struct table *table_init(unsigned long capacity,
                          double max_load_factor,
                          unsigned long (*hash_func)(const unsigned char *)) {
+    return table_init_flags(capacity, max_load_factor, hash_func,
+                            TABLE_DEFAULT_FLAGS);
+}
+
+struct table *table_init_flags(unsigned long capacity,
+                               double max_load_factor,
+                               unsigned long (*hash_func)(const unsigned char *),
+                               unsigned int flags) {
+    if (hash_func == NULL) {
+        return NULL;
+    }
+
+    return table_create(capacity, max_load_factor, hash_func, NULL, flags);
+}
+
+struct table *table_init_len(unsigned long capacity,
+                             double max_load_factor,
+                             unsigned long (*hash_len_func)(const unsigned char *,
+                                                            unsigned long),
+                             unsigned int flags) {
+    if (hash_len_func == NULL) {
+        return NULL;
+    }
+
+    return table_create(capacity, max_load_factor, NULL, hash_len_func, flags);
+}
+
+static struct table *table_create(unsigned long capacity,
+                                  double max_load_factor,
+                                  unsigned long (*hash_func)(const unsigned char *),
+                                  unsigned long (*hash_len_func)(const unsigned char *,
+                                                                 unsigned long),
+                                  unsigned int flags) {
 
     /* Note: The 'array' member of struct table is a pointer to a block of
      * memory that contains pointers to struct nodes. Make sure that the struct
@@ -63,87 +278,400 @@ struct table *table_init(unsigned long capacity,
         return NULL;
     }
 
+    table->hash_func = hash_func;
+    table->hash_len_func = hash_len_func;
+    table->max_load_factor = max_load_factor;
+    table->min_load_factor = 0.0;
+    table->min_capacity = capacity;
+    table->load = 0;
+    table->flat = NULL;
+    table->old_array = NULL;
+    table->old_capacity = 0;
+    table->rehash_index = 0;
+    table->rehash_step = 0;
+    table->free_nodes = NULL;
+    table->flags = flags;
+    table->bloom = NULL;
+    table->next_bloom = NULL;
+    table->bloom_bits = 0;
+    table->bloom_stale = 0;
+    table->seeded = 0;
+    table->seed = 0;
+    table->seed_capacity = 0;
+    table->interner = NULL;
+    table->arena = NULL;
+    if (flags & TABLE_ARENA) {
+        table->arena = arena_init(0);
+        if (table->arena == NULL) {
+            free(table);
+            return NULL;
+        }
+    }
+
+    if (flags & TABLE_FLAT) {
+        table->flat = flat_init(capacity, max_load_factor, table->arena,
+                                (flags & TABLE_COUNT_ONLY) != 0);
+        if (table->flat == NULL) {
+            arena_cleanup(table->arena);
+            free(table);
+            return NULL;
+        }
+        table->array = NULL;
+        table->capacity = 0;
+        return table;
+    }
+
     table->array = calloc(capacity, sizeof(struct node *));
     if (table->array == NULL) {
+        arena_cleanup(table->arena);
         free(table);
         return NULL;
     }
 
     table->capacity = capacity;
-    table->max_load_factor = max_load_factor;
-    table->hash_func = hash_func;
-    table->load = 0;
 
     return table;
 }
 
-struct node *node_init(const char *key) {
+/* Copy the key of a new node into the interner, the arena or a block of its
+ * own, terminated with a NUL. Returns NULL on failure. */
+static char *key_copy(struct table *t, const char *key, longtype key_len) {
+    if (t->interner != NULL) {
+        return (char *)interner_intern(t->interner, key, key_len);
+    }
+
+    if (t->arena != NULL) {
+        return arena_strndup(t->arena, key, key_len);
+    }
+
+    char *copy = malloc(key_len + 1);
+    if (copy != NULL) {
+        memcpy(copy, key, key_len);
+        copy[key_len] = '\0';
+    }
+    return copy;
+}
+
+/* Free a key copied by key_copy(), only keys of their own are freed. */
+static void key_free(struct table *t, char *key) {
+    if (t->interner == NULL && t->arena == NULL) {
+        free(key);
+    }
+}
+
+/* Allocate a node for key. Arena tables take the node from the free list or
+ * the arena, keys are copied by key_copy(). */
+struct node *node_init(struct table *t, const char *key, longtype key_len,
+                       longtype hash) {
     if (key == NULL) {
         return NULL;
     }
 
+    if (t->arena != NULL) {
+        struct node *new_node = t->free_nodes;
+        if (new_node != NULL) {
+            t->free_nodes = new_node->next;
+        } else {
+            new_node = arena_alloc(t->arena, sizeof(struct node));
+            if (new_node == NULL) {
+                return NULL;
+            }
+        }
+
+        new_node->key = key_copy(t, key, key_len);
+        if (new_node->key == NULL) {
+            new_node->next = t->free_nodes;
+            t->free_nodes = new_node;
+            return NULL;
+        }
+
+        array_init_embedded(&new_node->value,
+                            (t->flags & TABLE_COUNT_ONLY) != 0);
+        new_node->key_len = key_len;
+        new_node->hash = hash;
+        new_node->next = NULL;
+        return new_node;
+    }
+
     struct node *new_node = malloc(sizeof(struct node));
     if (new_node == NULL) {
         return NULL;
     }
 
-    new_node->key = malloc(strlen(key) + 1);
+    new_node->key = key_copy(t, key, key_len);
     if (new_node->key == NULL) {
         free(new_node);
         return NULL;
     }
 
-    strcpy(new_node->key, key);
+    new_node->key_len = key_len;
+    new_node->hash = hash;
 
-    new_node->value = array_init(ARRAY_SIZE);
-    if (new_node->value == NULL) {
-        free(new_node->key);
-        free(new_node);
-        return NULL;
-    }
+    array_init_embedded(&new_node->value, (t->flags & TABLE_COUNT_ONLY) != 0);
 
     new_node->next = NULL;
 
     return new_node;
 }
 
+/* Free a node that has been unlinked from the table. In an arena table the
+ * node is kept for reuse, its key bytes stay in the arena until cleanup. */
+static void node_free(struct table *t, struct node *n) {
+    array_release(&n->value);
 
-
-int table_insert(struct table *t, const char *key, int value) {
-    if (key == NULL || t == NULL) {
-        return 1;
+    if (t->arena != NULL) {
+        n->next = t->free_nodes;
+        t->free_nodes = n;
+        return;
     }
 
-    longtype hash = t->hash_func((const unsigned char *)key);
-    longtype index = hash % t->capacity;
+    key_free(t, n->key);
+    free(n);
+}
 
-    struct array *existing_array = table_lookup(t, key);
-    if (existing_array != NULL) {
-        if (array_append(existing_array, value) != 0) {
-            return 1;
+
+/* Returns the bucket slot or next pointer that points to the node holding
+ * key, or NULL if the key is not present. While an incremental resize is in
+ * progress, old buckets that have not been fully migrated are searched too.
+ * If walked is not NULL, the number of nodes passed over is stored in it. */
+static struct node **find_link(const struct table *t, const char *key,
+                               longtype key_len, longtype hash,
+                               longtype *walked) {
+    longtype count = 0;
+    struct node **link = &t->array[hash % t->capacity];
+    while (*link != NULL) {
+        if (node_matches(*link, key, key_len, hash)) {
+            return link;
+        }
+        link = &(*link)->next;
+        count++;
+    }
+
+    if (t->old_array != NULL) {
+        longtype old_index = hash % t->old_capacity;
+        if (old_index >= t->rehash_index) {
+            link = &t->old_array[old_index];
+            while (*link != NULL) {
+                if (node_matches(*link, key, key_len, hash)) {
+                    return link;
+                }
+                link = &(*link)->next;
+                count++;
+            }
         }
+    }
+
+    if (walked != NULL) {
+        *walked = count;
+    }
+
+    return NULL;
+}
+
+int table_set_rehash_step(struct table *t, unsigned long step) {
+    if (t == NULL) {
+        return -1;
+    }
+
+    if (step == 0) {
+        rehash_finish(t);
+    }
+
+    t->rehash_step = step;
+    return 0;
+}
+
+int table_set_min_load_factor(struct table *t, double min_load_factor) {
+    if (t == NULL || min_load_factor < 0.0
+        || min_load_factor * 2 >= t->max_load_factor) {
+        return -1;
+    }
+
+    if (t->flat != NULL) {
+        return flat_set_min_load_factor(t->flat, min_load_factor);
+    }
+
+    t->min_load_factor = min_load_factor;
+    return 0;
+}
+
+int table_enable_bloom(struct table *t, unsigned long bits_per_key) {
+    if (t == NULL || t->flat != NULL) {
+        return -1;
+    }
+
+    bloom_cleanup(t->bloom);
+    bloom_cleanup(t->next_bloom);
+    t->bloom = NULL;
+    t->next_bloom = NULL;
+    t->bloom_bits = bits_per_key;
+    if (bits_per_key == 0) {
         return 0;
     }
 
-    struct node *new_node = node_init(key);
-    if (new_node == NULL) {
+    bloom_rebuild(t);
+    if (t->bloom == NULL) {
+        t->bloom_bits = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Add the hash of every node in a bucket array to filter b, starting at
+ * bucket 'first'. */
+static void bloom_add_chains(struct bloom *b, struct node **array,
+                             longtype first, longtype capacity) {
+    for (longtype i = first; i < capacity; i++) {
+        for (struct node *n = array[i]; n != NULL; n = n->next) {
+            bloom_add(b, n->hash);
+        }
+    }
+}
+
+static void bloom_rebuild(struct table *t) {
+    struct bloom *b = bloom_init((longtype)((double)t->capacity *
+                                            t->max_load_factor) + 1,
+                                 t->bloom_bits);
+    if (b == NULL) {
+        return;
+    }
+
+    bloom_add_chains(b, t->array, 0, t->capacity);
+    if (t->old_array != NULL) {
+        bloom_add_chains(b, t->old_array, t->rehash_index, t->old_capacity);
+    }
+
+    /* During an incremental resize the capacity is already the new one, so
+     * this filter also replaces the one being filled. */
+    bloom_cleanup(t->bloom);
+    bloom_cleanup(t->next_bloom);
+    t->bloom = b;
+    t->next_bloom = NULL;
+    t->bloom_stale = 0;
+}
+
+int table_set_interner(struct table *t, struct interner *in) {
+    if (t == NULL) {
+        return -1;
+    }
+
+    /* Keys already in the table were copied the other way. */
+    if (t->flat != NULL ? flat_load_factor(t->flat) > 0.0 : t->load != 0) {
+        return -1;
+    }
+
+    t->interner = in;
+    if (t->flat != NULL) {
+        flat_set_interner(t->flat, in);
+    }
+
+    return 0;
+}
+
+int table_insert(struct table *t, const char *key, int value) {
+    struct array *values = table_upsert(t, key);
+    if (values == NULL) {
         return 1;
-    } else if (array_append(new_node->value, value) == 1) {
-        array_cleanup(new_node->value);
-        free(new_node->key);
-        free(new_node);
+    }
+
+    if (array_append(values, value) != 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+int table_insert_n(struct table *t, const char *key, unsigned long key_len,
+                   int value) {
+    struct array *values = table_upsert_n(t, key, key_len);
+    if (values == NULL) {
         return 1;
     }
 
+    if (array_append(values, value) != 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+struct array *table_upsert(struct table *t, const char *key) {
+    if (key == NULL || t == NULL) {
+        return NULL;
+    }
+
+    longtype key_len = strlen(key);
+    return upsert_hashed(t, key, key_len, table_hash(t, key, key_len));
+}
+
+struct array *table_upsert_n(struct table *t, const char *key,
+                             unsigned long key_len) {
+    longtype hash;
+    if (key == NULL || t == NULL || table_hash_n(t, key, key_len, &hash) != 0) {
+        return NULL;
+    }
+
+    return upsert_hashed(t, key, key_len, hash);
+}
+
+/* table_upsert() for a key that has already been hashed. */
+static struct array *upsert_hashed(struct table *t, const char *key,
+                                   longtype key_len, longtype hash) {
+    if (t->flat != NULL) {
+        return flat_upsert(t->flat, key, key_len, hash);
+    }
+
+    rehash_step(t);
+
+    longtype walked;
+    struct node **link = find_link(t, key, key_len, hash, &walked);
+    if (link != NULL) {
+        return &(*link)->value;
+    }
+
+    /* The first chain walked by find_link() is the bucket in the current
+     * array, so the new node goes in front of it. */
+    longtype index = hash % t->capacity;
+    struct node *new_node = node_init(t, key, key_len, hash);
+    if (new_node == NULL) {
+        return NULL;
+    }
+
     new_node->next = t->array[index];
     t->array[index] = new_node;
 
+    if (t->bloom != NULL) {
+        bloom_add(t->bloom, hash);
+        if (t->next_bloom != NULL) {
+            bloom_add(t->next_bloom, hash);
+        }
+    }
+
     t->load++;
+
+    /* Growing the table does not help against keys that share their full
+     * hash, a new seed does. Re-keying at most once per capacity keeps the
+     * cost amortised even if chains stay long. */
+    if (!(t->flags & TABLE_NO_RESEED)
+        && walked >= CHAIN_LIMIT + 4 * (longtype)ceil(t->max_load_factor)
+        && (!t->seeded || t->seed_capacity != t->capacity)) {
+        table_reseed(t);
+    }
+
     if (((double)t->load / (double)t->capacity) >= t->max_load_factor) {
-        resize_and_rehash(t);
+        if (t->rehash_step == 0) {
+            if (resize_and_rehash(t) == 0 && t->bloom != NULL) {
+                bloom_rebuild(t);
+            }
+        } else if (t->old_array == NULL) {
+            /* While a resize is still running the table may briefly exceed
+             * its load factor, so no single call does more than one step. */
+            rehash_start(t, t->capacity * 2);
+        }
     }
 
-    return 0;
+    return &new_node->value;
 }
 
 struct array *table_lookup(const struct table *t, const char *key) {
@@ -151,82 +679,410 @@ struct array *table_lookup(const struct table *t, const char *key) {
         return NULL;
     }
 
-    longtype hash = t->hash_func((const unsigned char *)key);
-    longtype index = hash % t->capacity;
+    longtype key_len = strlen(key);
+    return lookup_hashed(t, key, key_len, table_hash(t, key, key_len));
+}
+
+struct array *table_lookup_n(const struct table *t, const char *key,
+                             unsigned long key_len) {
+    longtype hash;
+    if (t == NULL || key == NULL || table_hash_n(t, key, key_len, &hash) != 0) {
+        return NULL;
+    }
+
+    return lookup_hashed(t, key, key_len, hash);
+}
+
+/* table_lookup() for a key that has already been hashed. */
+static struct array *lookup_hashed(const struct table *t, const char *key,
+                                   longtype key_len, longtype hash) {
+    if (t->flat != NULL) {
+        return flat_lookup(t->flat, key, key_len, hash);
+    }
+
+    /* Most misses end here, without touching the bucket array. */
+    if (t->bloom != NULL && !bloom_may_contain(t->bloom, hash)) {
+        return NULL;
+    }
 
-    struct node *current = t->array[index];
-    while (current != NULL) {
-        if (strcmp(current->key, key) == 0) {
-            return current->value;
+    /* Lookups only read the table and leave migration to inserts and
+     * deletes. find_link() searches the old array as well. */
+    struct node **link = find_link(t, key, key_len, hash, NULL);
+    if (link == NULL) {
+        return NULL;
+    }
+
+    return &(*link)->value;
+}
+
+/* Hash a block of at most BATCH_SIZE keys and prefetch the memory their
+ * lookups will touch, one stage at a time for the whole block, so the cache
+ * misses of different keys overlap. NULL keys are skipped. */
+static void batch_prepare(const struct table *t, const char **keys,
+                          longtype count, longtype *key_lens,
+                          longtype *hashes) {
+    for (longtype i = 0; i < count; i++) {
+        if (keys[i] != NULL) {
+            key_lens[i] = strlen(keys[i]);
+            hashes[i] = table_hash(t, keys[i], key_lens[i]);
         }
-        current = current->next;
     }
 
-    return NULL;
+    if (t->flat != NULL) {
+        for (longtype i = 0; i < count; i++) {
+            if (keys[i] != NULL) {
+                flat_prefetch(t->flat, hashes[i]);
+            }
+        }
+        return;
+    }
+
+    /* Stage 2: the bucket heads, or the filter blocks that decide whether
+     * the bucket is needed at all. */
+    for (longtype i = 0; i < count; i++) {
+        if (keys[i] != NULL) {
+            if (t->bloom != NULL) {
+                bloom_prefetch(t->bloom, hashes[i]);
+            } else {
+                PREFETCH(&t->array[hashes[i] % t->capacity]);
+            }
+        }
+    }
+
+    /* Keys the filter rejects never touch the bucket array. */
+    int wanted[BATCH_SIZE];
+    for (longtype i = 0; i < count; i++) {
+        wanted[i] = keys[i] != NULL
+                    && (t->bloom == NULL
+                        || bloom_may_contain(t->bloom, hashes[i]));
+    }
+
+    /* Stage 2b: the bucket heads of the keys that passed the filter, whose
+     * filter blocks should have arrived by now. */
+    if (t->bloom != NULL) {
+        for (longtype i = 0; i < count; i++) {
+            if (wanted[i]) {
+                PREFETCH(&t->array[hashes[i] % t->capacity]);
+            }
+        }
+    }
+
+#ifdef __GNUC__
+    /* Stage 3: the first node of every chain. Reading the bucket head is a
+     * real load, so without prefetching it would only add a miss. */
+    for (longtype i = 0; i < count; i++) {
+        if (wanted[i]) {
+            PREFETCH(t->array[hashes[i] % t->capacity]);
+        }
+    }
+#endif
 }
 
+int table_lookup_batch(const struct table *t, const char **keys,
+                       unsigned long n, struct array **results) {
+    if (t == NULL || keys == NULL || results == NULL) {
+        return -1;
+    }
+
+    longtype key_lens[BATCH_SIZE];
+    longtype hashes[BATCH_SIZE];
+
+    for (longtype start = 0; start < n; start += BATCH_SIZE) {
+        longtype count = n - start < BATCH_SIZE ? n - start : BATCH_SIZE;
+        const char **block = keys + start;
+
+        batch_prepare(t, block, count, key_lens, hashes);
+        for (longtype i = 0; i < count; i++) {
+            results[start + i] = block[i] == NULL
+                                     ? NULL
+                                     : lookup_hashed(t, block[i], key_lens[i],
+                                                     hashes[i]);
+        }
+    }
+
+    return 0;
+}
+
+int table_insert_batch(struct table *t, const char **keys, const int *values,
+                       unsigned long n) {
+    if (t == NULL || keys == NULL || values == NULL) {
+        return 1;
+    }
+
+    longtype key_lens[BATCH_SIZE];
+    longtype hashes[BATCH_SIZE];
+    int result = 0;
+
+    for (longtype start = 0; start < n; start += BATCH_SIZE) {
+        longtype count = n - start < BATCH_SIZE ? n - start : BATCH_SIZE;
+        const char **block = keys + start;
+
+        /* An insert may resize the table halfway through the block, which
+         * keeps every hash but makes the remaining prefetches useless. It may
+         * also re-key the table, which changes every hash, so the rest of
+         * the block is hashed again. */
+        batch_prepare(t, block, count, key_lens, hashes);
+        for (longtype i = 0; i < count; i++) {
+            if (block[i] == NULL) {
+                result = 1;
+                continue;
+            }
+
+            longtype seed = t->seed;
+            struct array *a = upsert_hashed(t, block[i], key_lens[i],
+                                            hashes[i]);
+            if (a == NULL || array_append(a, values[start + i]) != 0) {
+                result = 1;
+            }
+
+            if (t->seed != seed) {
+                for (longtype j = i + 1; j < count; j++) {
+                    if (block[j] != NULL) {
+                        hashes[j] = table_hash(t, block[j], key_lens[j]);
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
 
 double table_load_factor(const struct table *t) {
     if (t == NULL) {
         return -1.0;
     }
+
+    if (t->flat != NULL) {
+        return flat_load_factor(t->flat);
+    }
     return (double)t->load / (double)t->capacity;
 }
 
-int table_delete(struct table *t, const char *key) {
-    if (t == NULL || key == NULL) {
+/* Call visit for every node in the chains of a bucket array, starting at
+ * bucket 'first'. Stops at the first nonzero result and returns it. */
+static int visit_chains(struct node **array, longtype first,
+                        longtype capacity,
+                        int (*visit)(const char *, unsigned long,
+                                     const struct array *, void *),
+                        void *ctx) {
+    for (longtype i = first; i < capacity; i++) {
+        for (struct node *n = array[i]; n != NULL; n = n->next) {
+            int result = visit(n->key, n->key_len, &n->value, ctx);
+            if (result != 0) {
+                return result;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int table_foreach(const struct table *t,
+                  int (*visit)(const char *key, unsigned long key_len,
+                               const struct array *values, void *ctx),
+                  void *ctx) {
+    if (t == NULL || visit == NULL) {
         return -1;
     }
 
-    longtype hash = t->hash_func((const unsigned char *)key);
-    longtype index = hash % t->capacity;
+    if (t->flat != NULL) {
+        return flat_foreach(t->flat, visit, ctx);
+    }
 
-    struct node *current = t->array[index];
-    struct node *prev = NULL;
+    int result = visit_chains(t->array, 0, t->capacity, visit, ctx);
+    if (result == 0 && t->old_array != NULL) {
+        result = visit_chains(t->old_array, t->rehash_index, t->old_capacity,
+                              visit, ctx);
+    }
 
-    while (current != NULL) {
-        if (strcmp(current->key, key) == 0) {
-            if (prev == NULL) {
-                t->array[index] = current->next;
-            } else {
-                prev->next = current->next;
-            }
+    return result;
+}
 
-            array_cleanup(current->value);
-            free(current->key);
-            free(current);
+static int shrink_values(const char *key, unsigned long key_len,
+                         const struct array *values, void *ctx) {
+    (void)key;
+    (void)key_len;
+    (void)ctx;
+
+    /* The arrays belong to the table, the walk only hands them out const. */
+    return array_shrink_to_fit((struct array *)values);
+}
 
-            t->load--;
+int table_shrink_to_fit(struct table *t) {
+    if (t == NULL) {
+        return 1;
+    }
 
-            return 0;
+    return table_foreach(t, shrink_values, NULL) != 0;
+}
+
+/* Count the chain lengths of a bucket array into histogram, starting at
+ * bucket 'first'. Returns the longest chain seen. */
+static longtype count_chains(struct node **array, longtype first,
+                             longtype capacity, unsigned long *histogram,
+                             unsigned long bins) {
+    longtype longest = 0;
+
+    for (longtype i = first; i < capacity; i++) {
+        longtype length = 0;
+        for (struct node *n = array[i]; n != NULL; n = n->next) {
+            length++;
         }
 
-        prev = current;
-        current = current->next;
+        histogram[length < bins ? length : bins - 1]++;
+        if (length > longest) {
+            longest = length;
+        }
     }
 
-    return 1;
+    return longest;
 }
 
-void table_cleanup(struct table *t) {
-    if (t == NULL) {
-        return;
+long table_chain_histogram(const struct table *t, unsigned long *histogram,
+                           unsigned long bins) {
+    if (t == NULL || histogram == NULL || bins == 0) {
+        return -1;
     }
 
-    for (longtype i = 0; i < t->capacity; i++) {
-        struct node *current = t->array[i];
+    for (longtype i = 0; i < bins; i++) {
+        histogram[i] = 0;
+    }
+
+    if (t->flat != NULL) {
+        return flat_probe_histogram(t->flat, histogram, bins);
+    }
+
+    longtype longest = count_chains(t->array, 0, t->capacity, histogram,
+                                    bins);
+    if (t->old_array != NULL) {
+        longtype old_longest = count_chains(t->old_array, t->rehash_index,
+                                            t->old_capacity, histogram, bins);
+        if (old_longest > longest) {
+            longest = old_longest;
+        }
+    }
+
+    return (long)longest;
+}
+
+int table_delete(struct table *t, const char *key) {
+    if (t == NULL || key == NULL) {
+        return -1;
+    }
+
+    longtype key_len = strlen(key);
+    return delete_hashed(t, key, key_len, table_hash(t, key, key_len));
+}
+
+int table_delete_n(struct table *t, const char *key, unsigned long key_len) {
+    longtype hash;
+    if (t == NULL || key == NULL) {
+        return -1;
+    }
+
+    if (table_hash_n(t, key, key_len, &hash) != 0) {
+        return -1;
+    }
+
+    return delete_hashed(t, key, key_len, hash);
+}
+
+/* table_delete() for a key that has already been hashed. */
+static int delete_hashed(struct table *t, const char *key, longtype key_len,
+                         longtype hash) {
+    if (t->flat != NULL) {
+        return flat_delete(t->flat, key, key_len, hash);
+    }
+
+    if (t->bloom != NULL && !bloom_may_contain(t->bloom, hash)) {
+        return 1;
+    }
+
+    rehash_step(t);
+
+    struct node **link = find_link(t, key, key_len, hash, NULL);
+    if (link == NULL) {
+        return 1;
+    }
+
+    struct node *current = *link;
+    *link = current->next;
+
+    node_free(t, current);
+
+    t->load--;
+
+    /* Halving the array leaves it at most twice the minimum load factor,
+     * well below the maximum, so a purge followed by new inserts does not
+     * make the table alternate between growing and shrinking. */
+    if ((double)t->load < (double)t->capacity * t->min_load_factor
+        && t->capacity / 2 >= t->min_capacity && t->old_array == NULL) {
+        if (t->rehash_step == 0) {
+            if (rehash_to(t, t->capacity / 2) == 0 && t->bloom != NULL) {
+                bloom_rebuild(t);
+            }
+        } else {
+            rehash_start(t, t->capacity / 2);
+        }
+    }
+
+    /* Bits of deleted keys cannot be cleared, so the filter is rebuilt once
+     * they could make up a third of its keys. A rebuild reads the whole
+     * bucket array, so at least an eighth of the keys the filter was sized
+     * for must have been deleted as well, which keeps the cost of rebuilding
+     * constant per delete also when the table is nearly empty. */
+    longtype bloom_keys = (longtype)((double)t->capacity * t->max_load_factor);
+    if (t->bloom != NULL && ++t->bloom_stale > t->load / 2
+        && t->bloom_stale > bloom_keys / 8) {
+        bloom_rebuild(t);
+    }
+
+    return 0;
+}
+
+/* Free every node in the chains of a bucket array. Nodes of an arena table
+ * are released together with the arena, only their values are freed here. */
+static void free_chains(struct table *t, struct node **array,
+                        longtype capacity) {
+    for (longtype i = 0; i < capacity; i++) {
+        struct node *current = array[i];
         while (current != NULL) {
             struct node *temp = current;
             current = current->next;
 
-            array_cleanup(temp->value);
-            free(temp->key);
-            free(temp);
+            array_release(&temp->value);
+            if (t->arena == NULL) {
+                key_free(t, temp->key);
+                free(temp);
+            }
         }
     }
+}
 
+void table_cleanup(struct table *t) {
+    if (t == NULL) {
+        return;
+    }
+
+    if (t->flat != NULL) {
+        flat_cleanup(t->flat);
+        arena_cleanup(t->arena);
+        free(t);
+        return;
+    }
+
+    free_chains(t, t->array, t->capacity);
     free(t->array);
 
+    if (t->old_array != NULL) {
+        free_chains(t, t->old_array, t->old_capacity);
+        free(t->old_array);
+    }
+
+    bloom_cleanup(t->bloom);
+    bloom_cleanup(t->next_bloom);
+    arena_cleanup(t->arena);
     free(t);
 }
 
@@ -235,7 +1091,10 @@ int resize_and_rehash(struct table *t) {
         return -1;
     }
 
-    longtype new_capacity = t->capacity * 2;
+    return rehash_to(t, t->capacity * 2);
+}
+
+static int rehash_to(struct table *t, longtype new_capacity) {
     struct node **new_array = calloc(new_capacity, sizeof(struct node *));
     if (new_array == NULL) {
         return -1;
@@ -244,8 +1103,7 @@ int resize_and_rehash(struct table *t) {
     for (longtype i = 0; i < t->capacity; i++) {
         struct node *current = t->array[i];
         while (current != NULL) {
-            longtype new_index = t->hash_func((const unsigned char *)current->key)
-                                                 % new_capacity;
+            longtype new_index = current->hash % new_capacity;
 
             struct node *temp = current;
             current = current->next;
@@ -258,6 +1116,142 @@ int resize_and_rehash(struct table *t) {
     t->array = new_array;
     t->capacity = new_capacity;
 
+    return 0;
+}
+
+static int rehash_start(struct table *t, longtype new_capacity) {
+    struct node **new_array = calloc(new_capacity, sizeof(struct node *));
+    if (new_array == NULL) {
+        return -1;
+    }
+
+    t->old_array = t->array;
+    t->old_capacity = t->capacity;
+    t->rehash_index = 0;
+    t->array = new_array;
+    t->capacity = new_capacity;
+
+    if (t->bloom != NULL) {
+        t->next_bloom = bloom_init((longtype)((double)new_capacity *
+                                              t->max_load_factor) + 1,
+                                   t->bloom_bits);
+    }
 
     return 0;
 }
+
+static void rehash_finish(struct table *t) {
+    longtype step = t->rehash_step;
+
+    t->rehash_step = t->old_capacity;
+    while (t->old_array != NULL) {
+        rehash_step(t);
+    }
+    t->rehash_step = step;
+}
+
+/* Returns a seed that cannot be predicted from outside the process, falling
+ * back to the clock and the address of the table. */
+static longtype random_seed(const struct table *t) {
+    longtype seed = 0;
+    FILE *fp = fopen("/dev/urandom", "rb");
+    if (fp != NULL) {
+        if (fread(&seed, sizeof(seed), 1, fp) != 1) {
+            seed = 0;
+        }
+        fclose(fp);
+    }
+
+    if (seed == 0) {
+        seed = (longtype)time(NULL) ^ ((longtype)clock() << 32)
+               ^ (longtype)(uintptr_t)t;
+    }
+
+    return seed;
+}
+
+static int table_reseed(struct table *t) {
+    rehash_finish(t);
+
+    struct node **new_array = calloc(t->capacity, sizeof(struct node *));
+    if (new_array == NULL) {
+        return -1;
+    }
+
+    t->seed = random_seed(t);
+    t->seeded = 1;
+    t->seed_capacity = t->capacity;
+
+    for (longtype i = 0; i < t->capacity; i++) {
+        struct node *current = t->array[i];
+        while (current != NULL) {
+            struct node *temp = current;
+            current = current->next;
+
+            temp->hash = hash_wy_seed((const unsigned char *)temp->key,
+                                      temp->key_len, t->seed);
+            longtype index = temp->hash % t->capacity;
+            temp->next = new_array[index];
+            new_array[index] = temp;
+        }
+    }
+
+    free(t->array);
+    t->array = new_array;
+
+    /* The filter holds the old hashes, so it is dropped if it cannot be
+     * rebuilt. */
+    struct bloom *old_bloom = t->bloom;
+    if (old_bloom != NULL) {
+        bloom_rebuild(t);
+        if (t->bloom == old_bloom) {
+            bloom_cleanup(old_bloom);
+            t->bloom = NULL;
+        }
+    }
+
+    return 0;
+}
+
+static void rehash_step(struct table *t) {
+    if (t->old_array == NULL) {
+        return;
+    }
+
+    longtype moved = 0;
+    longtype empty_visits = t->rehash_step * REHASH_EMPTY_VISITS;
+
+    while (moved < t->rehash_step && t->rehash_index < t->old_capacity) {
+        struct node *current = t->old_array[t->rehash_index];
+        if (current == NULL) {
+            t->rehash_index++;
+            if (--empty_visits == 0) {
+                break;
+            }
+            continue;
+        }
+
+        t->old_array[t->rehash_index] = current->next;
+
+        longtype index = current->hash % t->capacity;
+        current->next = t->array[index];
+        t->array[index] = current;
+        if (t->next_bloom != NULL) {
+            bloom_add(t->next_bloom, current->hash);
+        }
+        moved++;
+    }
+
+    if (t->rehash_index == t->old_capacity) {
+        if (t->next_bloom != NULL) {
+            bloom_cleanup(t->bloom);
+            t->bloom = t->next_bloom;
+            t->next_bloom = NULL;
+            t->bloom_stale = 0;
+        }
+        free(t->old_array);
+        t->old_array = NULL;
+        t->old_capacity = 0;
+        t->rehash_index = 0;
+    }
+}
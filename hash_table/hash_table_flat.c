@@ -0,0 +1,474 @@
+/*
+ * Flat open addressing engine for the string hash table. Keys live in one
+ * array of slots, next to a separate array of 1-byte control tags. Every
+ * full slot has a tag made of 7 bits of its hash, so a lookup can compare
+ * 16 tags at once and only touches the slots (and key strings) whose tag
+ * matches. Probing happens per group of 16 slots.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "arena.h"
+#include "array.h"
+#include "hash_table_flat.h"
+#include "interner.h"
+
+/* Slots per probe group, one SSE2 register worth of control bytes. */
+#define GROUP_SIZE 16
+
+/* Control byte values. Full slots store a 7 bit tag (0x00 - 0x7f). */
+#define CTRL_EMPTY 0x80
+#define CTRL_DELETED 0xfe
+
+/* Open addressing degrades quickly past this point, so the table never
+ * fills up further than this, whatever the caller asks for. */
+#define FLAT_MAX_LOAD 0.875
+
+typedef unsigned long longtype;
+
+struct flat_slot {
+    /* Mixed hash of the key, kept so resizing does not rehash */
+    uint64_t hash;
+    char *key;
+    longtype key_len;
+    /* Separately allocated so the pointer handed out stays valid when slots
+     * move during a resize */
+    struct array *value;
+};
+
+struct flat_table {
+    /* One control byte per slot */
+    unsigned char *ctrl;
+    struct flat_slot *slots;
+    /* Arena for key copies and value arrays, NULL if they are allocated with
+     * malloc */
+    struct arena *arena;
+    /* Interner that owns the key bytes, NULL if keys are copied */
+    struct interner *interner;
+    /* Value arrays only count inserts */
+    int count_only;
+    double max_load_factor;
+    /* Load factor below which a delete halves the table, 0 if it never
+     * shrinks */
+    double min_load_factor;
+    /* Number of slots the table was created with */
+    longtype min_capacity;
+    /* Number of slots, a power of two and a multiple of GROUP_SIZE */
+    longtype capacity;
+    /* Number of full slots */
+    longtype load;
+    /* Number of deleted slots, these still lengthen probe sequences */
+    longtype tombstones;
+};
+
+/* The user hash functions can be weak in their lower bits (hash_too_simple
+ * only ever uses 8 bits), so the result is run through the murmur3
+ * finalizer before it is split into a group index and a tag. The tag comes
+ * from the top 7 of 64 bits, also where unsigned long is 32 bits wide. */
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+    return h;
+}
+
+static unsigned char hash_tag(uint64_t hash) {
+    return (unsigned char)(hash >> 57);
+}
+
+/* Return a bitmask with bit i set if ctrl[i] == byte, for the group that
+ * starts at ctrl. */
+static unsigned int group_match(const unsigned char *ctrl, unsigned char byte) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    __m128i cmp = _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte));
+    return (unsigned int)_mm_movemask_epi8(cmp);
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        if (ctrl[i] == byte) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+/* Bitmask of the empty or deleted slots in a group, both have the high bit
+ * set while full slots do not. */
+static unsigned int group_match_free(const unsigned char *ctrl) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128((const __m128i *)ctrl);
+    return (unsigned int)_mm_movemask_epi8(group);
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < GROUP_SIZE; i++) {
+        if (ctrl[i] & 0x80) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+static int lowest_bit(unsigned int mask) {
+    return __builtin_ctz(mask);
+}
+
+static longtype round_capacity(unsigned long capacity) {
+    longtype cap = GROUP_SIZE;
+    while (cap < capacity) {
+        cap *= 2;
+    }
+    return cap;
+}
+
+static int flat_alloc(struct flat_table *f, longtype capacity) {
+    f->ctrl = malloc(capacity);
+    if (f->ctrl == NULL) {
+        return -1;
+    }
+
+    f->slots = malloc(capacity * sizeof(struct flat_slot));
+    if (f->slots == NULL) {
+        free(f->ctrl);
+        return -1;
+    }
+
+    memset(f->ctrl, CTRL_EMPTY, capacity);
+    f->capacity = capacity;
+    f->load = 0;
+    f->tombstones = 0;
+    return 0;
+}
+
+struct flat_table *flat_init(unsigned long capacity,
+                             double max_load_factor,
+                             struct arena *arena,
+                             int count_only) {
+    struct flat_table *f = malloc(sizeof(struct flat_table));
+    if (f == NULL) {
+        return NULL;
+    }
+
+    if (max_load_factor <= 0.0 || max_load_factor > FLAT_MAX_LOAD) {
+        max_load_factor = FLAT_MAX_LOAD;
+    }
+
+    if (flat_alloc(f, round_capacity(capacity)) != 0) {
+        free(f);
+        return NULL;
+    }
+
+    f->arena = arena;
+    f->interner = NULL;
+    f->count_only = count_only;
+    f->max_load_factor = max_load_factor;
+    f->min_load_factor = 0.0;
+    f->min_capacity = f->capacity;
+
+    return f;
+}
+
+/* Return the slot index holding key, or -1 if it is not present. */
+static long flat_find(const struct flat_table *f, const char *key,
+                      longtype key_len, uint64_t hash) {
+    longtype group_mask = f->capacity / GROUP_SIZE - 1;
+    longtype group = hash & group_mask;
+    unsigned char tag = hash_tag(hash);
+
+    for (longtype step = 1; step <= group_mask + 1; step++) {
+        const unsigned char *ctrl = f->ctrl + group * GROUP_SIZE;
+        unsigned int match = group_match(ctrl, tag);
+        while (match != 0) {
+            longtype index = group * GROUP_SIZE
+                             + (longtype)lowest_bit(match);
+            if (f->slots[index].hash == hash
+                && f->slots[index].key_len == key_len
+                && (f->slots[index].key == key
+                    || memcmp(f->slots[index].key, key, key_len) == 0)) {
+                return (long)index;
+            }
+            match &= match - 1;
+        }
+
+        /* An empty slot ends the probe sequence, the key would have been
+         * placed here or earlier. */
+        if (group_match(ctrl, CTRL_EMPTY) != 0) {
+            return -1;
+        }
+
+        group = (group + step) & group_mask;
+    }
+
+    return -1;
+}
+
+/* Return the index of the first empty or deleted slot along the probe
+ * sequence of hash. The table always has free slots left. */
+static longtype flat_find_free(const struct flat_table *f, uint64_t hash) {
+    longtype group_mask = f->capacity / GROUP_SIZE - 1;
+    longtype group = hash & group_mask;
+
+    for (longtype step = 1;; step++) {
+        unsigned int free_mask = group_match_free(f->ctrl + group * GROUP_SIZE);
+        if (free_mask != 0) {
+            return group * GROUP_SIZE + (longtype)lowest_bit(free_mask);
+        }
+        group = (group + step) & group_mask;
+    }
+}
+
+/* Move every full slot into a freshly allocated table of new_capacity.
+ * Deleted slots are dropped along the way. */
+static int flat_rehash(struct flat_table *f, longtype new_capacity) {
+    unsigned char *old_ctrl = f->ctrl;
+    struct flat_slot *old_slots = f->slots;
+    longtype old_capacity = f->capacity;
+    longtype load = f->load;
+
+    if (flat_alloc(f, new_capacity) != 0) {
+        f->ctrl = old_ctrl;
+        f->slots = old_slots;
+        return -1;
+    }
+
+    for (longtype i = 0; i < old_capacity; i++) {
+        if (old_ctrl[i] & 0x80) {
+            continue;
+        }
+        longtype index = flat_find_free(f, old_slots[i].hash);
+        f->ctrl[index] = old_ctrl[i];
+        f->slots[index] = old_slots[i];
+    }
+    f->load = load;
+
+    free(old_ctrl);
+    free(old_slots);
+    return 0;
+}
+
+struct array *flat_upsert(struct flat_table *f, const char *key,
+                          unsigned long key_len, unsigned long hash) {
+    if (f == NULL || key == NULL) {
+        return NULL;
+    }
+
+    uint64_t mixed = mix(hash);
+    long found = flat_find(f, key, key_len, mixed);
+    if (found >= 0) {
+        return f->slots[found].value;
+    }
+
+    if ((double)(f->load + f->tombstones + 1)
+        > (double)f->capacity * f->max_load_factor) {
+        /* Mostly tombstones: clean up in place instead of growing. */
+        longtype new_capacity = f->tombstones > f->load
+                                    ? f->capacity : f->capacity * 2;
+        if (flat_rehash(f, new_capacity) != 0) {
+            return NULL;
+        }
+    }
+
+    struct flat_slot slot;
+    slot.hash = mixed;
+    slot.key_len = key_len;
+    if (f->interner != NULL) {
+        slot.key = (char *)interner_intern(f->interner, key, key_len);
+    } else if (f->arena != NULL) {
+        slot.key = arena_strndup(f->arena, key, key_len);
+    } else {
+        slot.key = malloc(key_len + 1);
+        if (slot.key != NULL) {
+            memcpy(slot.key, key, key_len);
+            slot.key[key_len] = '\0';
+        }
+    }
+    if (slot.key == NULL) {
+        return NULL;
+    }
+
+    if (f->arena != NULL) {
+        slot.value = arena_alloc(f->arena, sizeof(struct array));
+    } else {
+        slot.value = malloc(sizeof(struct array));
+    }
+    if (slot.value == NULL) {
+        if (f->arena == NULL && f->interner == NULL) {
+            free(slot.key);
+        }
+        return NULL;
+    }
+    array_init_embedded(slot.value, f->count_only);
+
+    longtype index = flat_find_free(f, mixed);
+    if (f->ctrl[index] == CTRL_DELETED) {
+        f->tombstones--;
+    }
+    f->ctrl[index] = hash_tag(mixed);
+    f->slots[index] = slot;
+    f->load++;
+
+    return slot.value;
+}
+
+struct array *flat_lookup(const struct flat_table *f, const char *key,
+                          unsigned long key_len, unsigned long hash) {
+    if (f == NULL || key == NULL) {
+        return NULL;
+    }
+
+    long found = flat_find(f, key, key_len, mix(hash));
+    if (found < 0) {
+        return NULL;
+    }
+
+    return f->slots[found].value;
+}
+
+void flat_set_interner(struct flat_table *f, struct interner *in) {
+    f->interner = in;
+}
+
+int flat_set_min_load_factor(struct flat_table *f, double min_load_factor) {
+    if (f == NULL || min_load_factor * 2 >= f->max_load_factor) {
+        return -1;
+    }
+
+    f->min_load_factor = min_load_factor;
+    return 0;
+}
+
+void flat_prefetch(const struct flat_table *f, unsigned long hash) {
+    longtype group = mix(hash) & (f->capacity / GROUP_SIZE - 1);
+#ifdef __GNUC__
+    __builtin_prefetch(f->ctrl + group * GROUP_SIZE);
+    __builtin_prefetch(f->slots + group * GROUP_SIZE);
+#else
+    (void)group;
+#endif
+}
+
+double flat_load_factor(const struct flat_table *f) {
+    if (f == NULL) {
+        return -1.0;
+    }
+    return (double)f->load / (double)f->capacity;
+}
+
+int flat_foreach(const struct flat_table *f,
+                 int (*visit)(const char *, unsigned long,
+                              const struct array *, void *),
+                 void *ctx) {
+    for (longtype i = 0; i < f->capacity; i++) {
+        if (f->ctrl[i] & 0x80) {
+            continue;
+        }
+
+        int result = visit(f->slots[i].key, f->slots[i].key_len,
+                           f->slots[i].value, ctx);
+        if (result != 0) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+long flat_probe_histogram(const struct flat_table *f, unsigned long *histogram,
+                          unsigned long bins) {
+    longtype group_mask = f->capacity / GROUP_SIZE - 1;
+    longtype longest = 0;
+
+    for (longtype i = 0; i < f->capacity; i++) {
+        if (f->ctrl[i] & 0x80) {
+            continue;
+        }
+
+        /* Replay the probe sequence until it reaches the group of slot i. */
+        longtype group = f->slots[i].hash & group_mask;
+        longtype distance = 0;
+        while (group != i / GROUP_SIZE) {
+            distance++;
+            group = (group + distance) & group_mask;
+        }
+
+        histogram[distance < bins ? distance : bins - 1]++;
+        if (distance > longest) {
+            longest = distance;
+        }
+    }
+
+    return (long)longest;
+}
+
+int flat_delete(struct flat_table *f, const char *key,
+                unsigned long key_len, unsigned long hash) {
+    if (f == NULL || key == NULL) {
+        return -1;
+    }
+
+    long found = flat_find(f, key, key_len, mix(hash));
+    if (found < 0) {
+        return 1;
+    }
+
+    array_release(f->slots[found].value);
+    if (f->arena == NULL) {
+        free(f->slots[found].value);
+        if (f->interner == NULL) {
+            free(f->slots[found].key);
+        }
+    }
+
+    /* If the group still has an empty slot no probe sequence ever went past
+     * it, so the slot can be marked empty instead of deleted. */
+    longtype group_start = (longtype)found & ~(longtype)(GROUP_SIZE - 1);
+    if (group_match(f->ctrl + group_start, CTRL_EMPTY) != 0) {
+        f->ctrl[found] = CTRL_EMPTY;
+    } else {
+        f->ctrl[found] = CTRL_DELETED;
+        f->tombstones++;
+    }
+    f->load--;
+
+    /* Rehashing into half the slots also drops every tombstone. If it
+     * fails the table simply stays at its current size. */
+    if ((double)f->load < (double)f->capacity * f->min_load_factor
+        && f->capacity / 2 >= f->min_capacity) {
+        flat_rehash(f, f->capacity / 2);
+    }
+
+    return 0;
+}
+
+void flat_cleanup(struct flat_table *f) {
+    if (f == NULL) {
+        return;
+    }
+
+    for (longtype i = 0; i < f->capacity; i++) {
+        if (f->ctrl[i] & 0x80) {
+            continue;
+        }
+        array_release(f->slots[i].value);
+        if (f->arena == NULL) {
+            free(f->slots[i].value);
+            if (f->interner == NULL) {
+                free(f->slots[i].key);
+            }
+        }
+    }
+
+    free(f->ctrl);
+    free(f->slots);
+    free(f);
+}
@@ -0,0 +1,60 @@
+/* Flat open addressing engine used by hash_table.c for tables created with
+ * the TABLE_FLAT flag. Not meant to be used directly, the functions mirror
+ * the ones in hash_table.h but take the key length and the hash of the key
+ * as computed by the table. */
+
+/* Handle to the flat table. */
+struct flat_table;
+
+struct arena;
+struct interner;
+
+/* Initialise a flat table with room for at least 'capacity' slots. Key copies
+ * and value arrays are allocated from 'arena' unless it is NULL, the arena is
+ * owned by the caller. If count_only is 1 the value arrays only count the
+ * number of inserts. Returns NULL on failure. */
+struct flat_table *flat_init(unsigned long capacity,
+                             double max_load_factor,
+                             struct arena *arena,
+                             int count_only);
+
+/* Same semantics as table_upsert(). */
+struct array *flat_upsert(struct flat_table *f, const char *key,
+                          unsigned long key_len, unsigned long hash);
+
+/* Same semantics as table_lookup(). */
+struct array *flat_lookup(const struct flat_table *f, const char *key,
+                          unsigned long key_len, unsigned long hash);
+
+/* Take key bytes from interner 'in' instead of copying them, only while the
+ * table is empty. */
+void flat_set_interner(struct flat_table *f, struct interner *in);
+
+/* Same semantics as table_set_min_load_factor(), checked against the
+ * maximum load factor of the flat table, which may be lower than the one the
+ * table was created with. */
+int flat_set_min_load_factor(struct flat_table *f, double min_load_factor);
+
+/* Prefetch the control bytes and slots a lookup of hash starts at. */
+void flat_prefetch(const struct flat_table *f, unsigned long hash);
+
+/* Same semantics as table_load_factor(). */
+double flat_load_factor(const struct flat_table *f);
+
+/* Same semantics as table_foreach(). */
+int flat_foreach(const struct flat_table *f,
+                 int (*visit)(const char *, unsigned long,
+                              const struct array *, void *),
+                 void *ctx);
+
+/* Same semantics as table_chain_histogram(), counting for every key how many
+ * groups past its home group it is stored. histogram must be zeroed. */
+long flat_probe_histogram(const struct flat_table *f, unsigned long *histogram,
+                          unsigned long bins);
+
+/* Same semantics as table_delete(). */
+int flat_delete(struct flat_table *f, const char *key,
+                unsigned long key_len, unsigned long hash);
+
+/* Same semantics as table_cleanup(). */
+void flat_cleanup(struct flat_table *f);
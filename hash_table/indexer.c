@@ -0,0 +1,535 @@
+/*
+ * Parallel word index built on struct table.
+ *
+ * Maps the input files into memory and maps every word (a run of letters and
+ * digits, lowercased) to the numbers of the lines it occurs on. Lines are
+ * numbered from 1 across all files, as if they were concatenated, and every
+ * line is recorded once per word.
+ *
+ * The input is split into one contiguous range per thread, cut on line
+ * boundaries. Each thread first counts the lines in its range, a prefix sum
+ * over the counts gives the number of its first line, and then every thread
+ * tokenizes its range into its own tables, one per shard, selected by a hash
+ * of the word. Because the ranges are in input order, merging shard s of
+ * thread 0, 1, ... in turn keeps every value list sorted, and the shards are
+ * merged in parallel, one thread per shard.
+ *
+ * Build:
+ *   gcc -O2 -pthread -o indexer indexer.c hash_table.c hash_table_flat.c \
+ *       hash_func.c array.c arena.c bloom.c interner.c -lm
+ *
+ * Usage: indexer [-t threads] [-F] [-q word]... file...
+ *   -t  number of threads and shards (default: number of online CPUs)
+ *   -F  use TABLE_FLAT tables
+ *   -q  print the lines of word after indexing, may be repeated
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "array.h"
+#include "hash_func.h"
+#include "hash_table.h"
+
+/* Longer words are cut to this many bytes. */
+#define MAX_WORD 255
+
+/* Starting capacity of all shards of a worker together. Every worker has
+ * one table per shard, so the tool keeps threads * threads tables, and
+ * giving each of them the whole capacity made the memory grow with the
+ * square of the thread count. The tables still grow as needed. */
+#define TABLE_CAPACITY 4096
+#define MIN_SHARD_CAPACITY 64
+#define TABLE_LOAD 0.75
+
+/* Seed for picking the shard of a word, independent of the table hash. */
+#define SHARD_SEED 0x9e3779b97f4a7c15UL
+
+struct input {
+    const char *path;
+    const char *data;
+    unsigned long size;
+    /* Offset of the first byte in the concatenated input */
+    unsigned long offset;
+};
+
+struct worker {
+    pthread_t thread;
+    const struct input *inputs;
+    unsigned long n_inputs;
+    /* Range of the concatenated input handled by this worker */
+    unsigned long begin;
+    unsigned long end;
+    unsigned long lines;
+    unsigned long first_line;
+    /* One table per shard */
+    struct table **shards;
+    unsigned long n_shards;
+    unsigned int flags;
+    int error;
+};
+
+struct merger {
+    pthread_t thread;
+    struct worker *workers;
+    unsigned long n_workers;
+    unsigned long shard;
+    int error;
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static unsigned long shard_of(const char *word, unsigned long len,
+                              unsigned long n_shards) {
+    return hash_wy_seed((const unsigned char *)word, len, SHARD_SEED) %
+           n_shards;
+}
+
+/* Map every file into memory. Empty files are kept with a NULL mapping.
+ * Returns the total size, or -1 on failure. */
+static long inputs_open(struct input *inputs, unsigned long n) {
+    unsigned long offset = 0;
+
+    for (unsigned long i = 0; i < n; i++) {
+        struct stat st;
+        int fd = open(inputs[i].path, O_RDONLY);
+        if (fd == -1 || fstat(fd, &st) == -1) {
+            perror(inputs[i].path);
+            if (fd != -1) {
+                close(fd);
+            }
+            return -1;
+        }
+
+        inputs[i].size = (unsigned long)st.st_size;
+        inputs[i].offset = offset;
+        inputs[i].data = NULL;
+        if (inputs[i].size > 0) {
+            void *data = mmap(NULL, inputs[i].size, PROT_READ, MAP_PRIVATE,
+                              fd, 0);
+            if (data == MAP_FAILED) {
+                perror(inputs[i].path);
+                close(fd);
+                return -1;
+            }
+            posix_madvise(data, inputs[i].size, POSIX_MADV_SEQUENTIAL);
+            inputs[i].data = data;
+        }
+        close(fd);
+        offset += inputs[i].size;
+    }
+
+    return (long)offset;
+}
+
+static void inputs_close(struct input *inputs, unsigned long n) {
+    for (unsigned long i = 0; i < n; i++) {
+        if (inputs[i].data != NULL) {
+            munmap((void *)inputs[i].data, inputs[i].size);
+        }
+    }
+}
+
+/* Move offset forward to the start of the next line, file ends count as line
+ * ends. Returns the adjusted offset. */
+static unsigned long line_boundary(const struct input *inputs, unsigned long n,
+                                   unsigned long offset) {
+    for (unsigned long i = 0; i < n; i++) {
+        const struct input *in = &inputs[i];
+        if (offset == in->offset) {
+            return offset;
+        }
+        if (offset < in->offset + in->size) {
+            const char *nl = memchr(in->data + (offset - in->offset - 1), '\n',
+                                    in->size - (offset - in->offset - 1));
+            return nl == NULL ? in->offset + in->size
+                              : in->offset + (unsigned long)(nl - in->data) + 1;
+        }
+    }
+
+    return offset;
+}
+
+/* Count the lines of each file part in the range of the worker. A part ends
+ * on a line boundary, so a last line without newline only occurs at the end
+ * of a file. */
+static void *count_lines(void *arg) {
+    struct worker *w = arg;
+
+    w->lines = 0;
+    for (unsigned long i = 0; i < w->n_inputs; i++) {
+        const struct input *in = &w->inputs[i];
+        unsigned long lo = w->begin > in->offset ? w->begin - in->offset : 0;
+        unsigned long hi = w->end < in->offset + in->size
+                               ? w->end - in->offset : in->size;
+        if (in->offset >= w->end || lo >= hi) {
+            continue;
+        }
+
+        const char *p = in->data + lo;
+        const char *stop = in->data + hi;
+        while ((p = memchr(p, '\n', (unsigned long)(stop - p))) != NULL) {
+            w->lines++;
+            p++;
+        }
+        if (stop[-1] != '\n') {
+            w->lines++;
+        }
+    }
+
+    return NULL;
+}
+
+/* Record line for word, skipping repeats of the word on the same line.
+ * Returns 0 if successful and 1 otherwise. */
+static int add_word(struct worker *w, const char *word, unsigned long len,
+                    int line) {
+    struct table *t = w->shards[shard_of(word, len, w->n_shards)];
+    struct array *values = table_upsert(t, word);
+    if (values == NULL) {
+        return 1;
+    }
+
+    unsigned long size = array_size(values);
+    if (size > 0 && array_get(values, size - 1) == line) {
+        return 0;
+    }
+
+    return array_append(values, line) != 0;
+}
+
+static int index_part(struct worker *w, const char *p, const char *stop,
+                      unsigned long *line) {
+    char word[MAX_WORD + 1];
+    unsigned long len = 0;
+
+    for (; p < stop; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (isalnum(c)) {
+            if (len < MAX_WORD) {
+                word[len++] = (char)tolower(c);
+            }
+            continue;
+        }
+
+        if (len > 0) {
+            word[len] = '\0';
+            if (add_word(w, word, len, (int)*line) != 0) {
+                return 1;
+            }
+            len = 0;
+        }
+        if (c == '\n') {
+            (*line)++;
+        }
+    }
+
+    if (len > 0) {
+        word[len] = '\0';
+        if (add_word(w, word, len, (int)*line) != 0) {
+            return 1;
+        }
+    }
+    if (stop[-1] != '\n') {
+        (*line)++;
+    }
+
+    return 0;
+}
+
+static void *index_range(void *arg) {
+    struct worker *w = arg;
+    unsigned long line = w->first_line;
+    unsigned long capacity = TABLE_CAPACITY / w->n_shards;
+    if (capacity < MIN_SHARD_CAPACITY) {
+        capacity = MIN_SHARD_CAPACITY;
+    }
+
+    for (unsigned long s = 0; s < w->n_shards; s++) {
+        w->shards[s] = table_init_len(capacity, TABLE_LOAD, hash_wy,
+                                      w->flags | TABLE_ARENA);
+        if (w->shards[s] == NULL) {
+            w->error = 1;
+            return NULL;
+        }
+    }
+
+    for (unsigned long i = 0; i < w->n_inputs; i++) {
+        const struct input *in = &w->inputs[i];
+        unsigned long lo = w->begin > in->offset ? w->begin - in->offset : 0;
+        unsigned long hi = w->end < in->offset + in->size
+                               ? w->end - in->offset : in->size;
+        if (in->offset >= w->end || lo >= hi) {
+            continue;
+        }
+
+        if (index_part(w, in->data + lo, in->data + hi, &line) != 0) {
+            w->error = 1;
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/* Append the values of a key of a later worker to the merged table. */
+static int merge_key(const char *key, unsigned long key_len,
+                     const struct array *values, void *ctx) {
+    struct array *merged = table_upsert(ctx, key);
+    (void)key_len;
+    if (merged == NULL) {
+        return 1;
+    }
+
+    unsigned long size = array_size(values);
+    for (unsigned long i = 0; i < size; i++) {
+        if (array_append(merged, array_get(values, i)) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Merge shard s of all workers into the table of the first worker, which
+ * holds the lowest line numbers. */
+static void *merge_shard(void *arg) {
+    struct merger *m = arg;
+    struct table *merged = m->workers[0].shards[m->shard];
+
+    for (unsigned long i = 1; i < m->n_workers; i++) {
+        struct table *t = m->workers[i].shards[m->shard];
+        if (table_foreach(t, merge_key, merged) != 0) {
+            m->error = 1;
+        }
+        table_cleanup(t);
+        m->workers[i].shards[m->shard] = NULL;
+        if (m->error) {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+static int count_postings(const char *key, unsigned long key_len,
+                          const struct array *values, void *ctx) {
+    (void)key;
+    (void)key_len;
+    ((unsigned long *)ctx)[0]++;
+    ((unsigned long *)ctx)[1] += array_size(values);
+    return 0;
+}
+
+/* Run f on every worker in its own thread and wait for all of them.
+ * Returns 0 if successful and 1 otherwise. */
+static int run_workers(struct worker *workers, unsigned long n,
+                       void *(*f)(void *)) {
+    unsigned long started = 0;
+    int error = 0;
+
+    for (; started < n; started++) {
+        if (pthread_create(&workers[started].thread, NULL, f,
+                           &workers[started]) != 0) {
+            error = 1;
+            break;
+        }
+    }
+    for (unsigned long i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        error |= workers[i].error;
+    }
+
+    return error;
+}
+
+static void print_word(struct table **shards, unsigned long n_shards,
+                       const char *query) {
+    char word[MAX_WORD + 1];
+    unsigned long len = 0;
+
+    for (; query[len] != '\0' && len < MAX_WORD; len++) {
+        word[len] = (char)tolower((unsigned char)query[len]);
+    }
+    word[len] = '\0';
+
+    struct array *values = table_lookup(shards[shard_of(word, len, n_shards)],
+                                        word);
+    if (values == NULL) {
+        printf("%s: not found\n", word);
+        return;
+    }
+
+    unsigned long size = array_size(values);
+    printf("%s: %lu lines", word, size);
+    for (unsigned long i = 0; i < size; i++) {
+        printf(" %d", array_get(values, i));
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long n_threads = cpus > 0 ? (unsigned long)cpus : 1;
+    unsigned int flags = 0;
+    const char **queries = calloc((unsigned long)argc, sizeof(char *));
+    unsigned long n_queries = 0;
+    int opt;
+
+    if (queries == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    while ((opt = getopt(argc, argv, "t:Fq:")) != -1) {
+        switch (opt) {
+        case 't':
+            n_threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'F':
+            flags |= TABLE_FLAT;
+            break;
+        case 'q':
+            queries[n_queries++] = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-F] [-q word]... file...\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind == argc || n_threads == 0) {
+        fprintf(stderr, "usage: %s [-t threads] [-F] [-q word]... file...\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    unsigned long n_inputs = (unsigned long)(argc - optind);
+    struct input *inputs = calloc(n_inputs, sizeof(struct input));
+    struct worker *workers = calloc(n_threads, sizeof(struct worker));
+    struct merger *mergers = calloc(n_threads, sizeof(struct merger));
+    struct table **shards = calloc(n_threads * n_threads,
+                                   sizeof(struct table *));
+    if (inputs == NULL || workers == NULL || mergers == NULL ||
+        shards == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (unsigned long i = 0; i < n_inputs; i++) {
+        inputs[i].path = argv[optind + (int)i];
+    }
+
+    double start = now();
+    long total = inputs_open(inputs, n_inputs);
+    if (total < 0) {
+        return EXIT_FAILURE;
+    }
+
+    unsigned long begin = 0;
+    for (unsigned long i = 0; i < n_threads; i++) {
+        unsigned long end = (unsigned long)total / n_threads * (i + 1);
+        end = i + 1 == n_threads ? (unsigned long)total
+                                 : line_boundary(inputs, n_inputs, end);
+        if (end < begin) {
+            end = begin;
+        }
+
+        workers[i].inputs = inputs;
+        workers[i].n_inputs = n_inputs;
+        workers[i].begin = begin;
+        workers[i].end = end;
+        workers[i].shards = shards + i * n_threads;
+        workers[i].n_shards = n_threads;
+        workers[i].flags = flags;
+        begin = end;
+    }
+
+    if (run_workers(workers, n_threads, count_lines) != 0) {
+        fprintf(stderr, "could not start threads\n");
+        return EXIT_FAILURE;
+    }
+
+    unsigned long lines = 0;
+    for (unsigned long i = 0; i < n_threads; i++) {
+        workers[i].first_line = lines + 1;
+        lines += workers[i].lines;
+    }
+    if (lines > INT_MAX) {
+        fprintf(stderr, "too many lines\n");
+        return EXIT_FAILURE;
+    }
+
+    if (run_workers(workers, n_threads, index_range) != 0) {
+        fprintf(stderr, "indexing failed\n");
+        return EXIT_FAILURE;
+    }
+    double indexed = now();
+
+    for (unsigned long s = 0; s < n_threads; s++) {
+        mergers[s].workers = workers;
+        mergers[s].n_workers = n_threads;
+        mergers[s].shard = s;
+    }
+
+    unsigned long started = 0;
+    int error = 0;
+    for (; started < n_threads; started++) {
+        if (pthread_create(&mergers[started].thread, NULL, merge_shard,
+                           &mergers[started]) != 0) {
+            error = 1;
+            break;
+        }
+    }
+    for (unsigned long s = 0; s < started; s++) {
+        pthread_join(mergers[s].thread, NULL);
+        error |= mergers[s].error;
+    }
+    if (error) {
+        fprintf(stderr, "merging failed\n");
+        return EXIT_FAILURE;
+    }
+    double merged = now();
+
+    /* The merged shards are the tables of the first worker. */
+    unsigned long counts[2] = {0, 0};
+    for (unsigned long s = 0; s < n_threads; s++) {
+        table_foreach(shards[s], count_postings, counts);
+    }
+
+    printf("%lu files, %lu bytes, %lu lines, %lu words, %lu postings\n",
+           n_inputs, (unsigned long)total, lines, counts[0], counts[1]);
+    printf("%lu threads: index %.3f s, merge %.3f s, %.1f MB/s\n", n_threads,
+           indexed - start, merged - indexed,
+           (double)total / (merged - start) / 1e6);
+
+    for (unsigned long i = 0; i < n_queries; i++) {
+        print_word(shards, n_threads, queries[i]);
+    }
+
+    for (unsigned long s = 0; s < n_threads; s++) {
+        table_cleanup(shards[s]);
+    }
+    inputs_close(inputs, n_inputs);
+    free(shards);
+    free(mergers);
+    free(workers);
+    free(inputs);
+    free(queries);
+    return EXIT_SUCCESS;
+}
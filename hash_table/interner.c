@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "hash_func.h"
+#include "interner.h"
+
+/* Starting number of slots, always a power of two. */
+#define INITIAL_CAPACITY 1024
+
+/* Linear probing stays short below this load. */
+#define MAX_LOAD 0.5
+
+typedef unsigned long longtype;
+
+struct entry {
+    longtype hash;
+    /* Interned copy, NULL for an empty slot */
+    const char *key;
+    longtype key_len;
+};
+
+struct interner {
+    struct entry *entries;
+    longtype capacity;
+    longtype size;
+    /* Holds the key bytes, keys are never removed on their own */
+    struct arena *arena;
+};
+
+struct interner *interner_init(void) {
+    struct interner *in = malloc(sizeof(struct interner));
+    if (in == NULL) {
+        return NULL;
+    }
+
+    in->entries = calloc(INITIAL_CAPACITY, sizeof(struct entry));
+    in->arena = arena_init(0);
+    if (in->entries == NULL || in->arena == NULL) {
+        free(in->entries);
+        arena_cleanup(in->arena);
+        free(in);
+        return NULL;
+    }
+
+    in->capacity = INITIAL_CAPACITY;
+    in->size = 0;
+    return in;
+}
+
+/* Returns the slot holding key, or the empty slot where it would go. */
+static struct entry *find_slot(const struct interner *in, const char *key,
+                               longtype key_len, longtype hash) {
+    longtype mask = in->capacity - 1;
+    longtype index = hash & mask;
+
+    for (;;) {
+        struct entry *e = &in->entries[index];
+        if (e->key == NULL
+            || (e->hash == hash && e->key_len == key_len
+                && memcmp(e->key, key, key_len) == 0)) {
+            return e;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+/* Double the number of slots. Returns 0 if successful and -1 otherwise. */
+static int grow(struct interner *in) {
+    longtype new_capacity = in->capacity * 2;
+    struct entry *entries = calloc(new_capacity, sizeof(struct entry));
+    if (entries == NULL) {
+        return -1;
+    }
+
+    struct entry *old = in->entries;
+    longtype old_capacity = in->capacity;
+    in->entries = entries;
+    in->capacity = new_capacity;
+
+    for (longtype i = 0; i < old_capacity; i++) {
+        if (old[i].key != NULL) {
+            *find_slot(in, old[i].key, old[i].key_len, old[i].hash) = old[i];
+        }
+    }
+
+    free(old);
+    return 0;
+}
+
+const char *interner_intern(struct interner *in, const char *key,
+                            unsigned long key_len) {
+    if (in == NULL || key == NULL) {
+        return NULL;
+    }
+
+    longtype hash = hash_wy((const unsigned char *)key, key_len);
+    struct entry *e = find_slot(in, key, key_len, hash);
+    if (e->key != NULL) {
+        return e->key;
+    }
+
+    if ((double)(in->size + 1) > (double)in->capacity * MAX_LOAD) {
+        if (grow(in) != 0) {
+            return NULL;
+        }
+        e = find_slot(in, key, key_len, hash);
+    }
+
+    char *copy = arena_strndup(in->arena, key, key_len);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    e->hash = hash;
+    e->key = copy;
+    e->key_len = key_len;
+    in->size++;
+
+    return copy;
+}
+
+const char *interner_find(const struct interner *in, const char *key,
+                          unsigned long key_len) {
+    if (in == NULL || key == NULL) {
+        return NULL;
+    }
+
+    longtype hash = hash_wy((const unsigned char *)key, key_len);
+    return find_slot(in, key, key_len, hash)->key;
+}
+
+unsigned long interner_size(const struct interner *in) {
+    if (in == NULL) {
+        return 0;
+    }
+
+    return in->size;
+}
+
+unsigned long interner_footprint(const struct interner *in) {
+    if (in == NULL) {
+        return 0;
+    }
+
+    return sizeof(struct interner) + in->capacity * sizeof(struct entry)
+           + arena_footprint(in->arena);
+}
+
+void interner_cleanup(struct interner *in) {
+    if (in == NULL) {
+        return;
+    }
+
+    arena_cleanup(in->arena);
+    free(in->entries);
+    free(in);
+}
@@ -0,0 +1,33 @@
+/* String interner interface
+ * Keeps one copy of every distinct key, so tables that index the same
+ * vocabulary can share their key bytes, see table_set_interner(). Interned
+ * keys are NUL-terminated, never move and stay valid until the interner is
+ * cleaned up, so two interned keys are equal exactly if their pointers are.
+ * Keys may contain any bytes, including NUL. */
+
+/* Handle to interner data structure. */
+struct interner;
+
+/* Initialise an empty interner and return a pointer to it.
+ * Returns NULL on failure. */
+struct interner *interner_init(void);
+
+/* Returns the interned copy of the key_len bytes at key, copying them into
+ * the interner if they were not interned yet. Returns NULL on failure. */
+const char *interner_intern(struct interner *in, const char *key,
+                            unsigned long key_len);
+
+/* Returns the interned copy of the key_len bytes at key, or NULL if they
+ * have not been interned. */
+const char *interner_find(const struct interner *in, const char *key,
+                          unsigned long key_len);
+
+/* Returns the number of distinct keys in the interner. */
+unsigned long interner_size(const struct interner *in);
+
+/* Returns the number of bytes used by the interner. */
+unsigned long interner_footprint(const struct interner *in);
+
+/* Clean up the interner and every key in it. Tables using the interner must
+ * be cleaned up first. */
+void interner_cleanup(struct interner *in);
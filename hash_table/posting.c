@@ -0,0 +1,476 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "array.h"
+#include "posting.h"
+
+typedef unsigned long longtype;
+
+/* A block is packed as LANES interleaved bit streams of ROWS values each:
+ * value i lives in lane i % LANES. Deltas are taken against the value LANES
+ * positions earlier, so a row of LANES values is unpacked and prefix summed
+ * with a handful of SSE2 instructions, and the scalar fallback reads the same
+ * layout. Lane j of a block with width b owns words j, j + LANES, ... */
+#define LANES 4
+#define ROWS (POSTING_BLOCK / LANES)
+
+/* Skip entry for one packed block. Packed lists store these as they are, so
+ * the fields have fixed sizes. */
+struct posting_skip {
+    /* Last value of the block, deltas of the next block start from it */
+    int32_t last;
+    /* Bits per delta, 0 to 32 */
+    uint32_t bits;
+    /* Index of the first packed word of the block */
+    uint64_t offset;
+};
+
+static longtype align8(longtype size) {
+    return (size + 7) & ~(longtype)7;
+}
+
+struct posting *posting_init(void) {
+    struct posting *p = malloc(sizeof(struct posting));
+    if (p == NULL) {
+        return NULL;
+    }
+
+    p->words = NULL;
+    p->n_words = 0;
+    p->words_capacity = 0;
+    p->blocks = NULL;
+    p->n_blocks = 0;
+    p->blocks_capacity = 0;
+    p->tail_size = 0;
+    p->view = 0;
+
+    return p;
+}
+
+/* Value the deltas of the next block are taken against. */
+static int block_base(const struct posting *p) {
+    return p->n_blocks > 0 ? p->blocks[p->n_blocks - 1].last : 0;
+}
+
+static unsigned int bit_width(uint32_t x) {
+    unsigned int bits = 0;
+    while (x != 0) {
+        bits++;
+        x >>= 1;
+    }
+    return bits;
+}
+
+/* Compress the full tail into a new block.
+ * Returns 0 if successful and 1 otherwise. */
+static int block_pack(struct posting *p) {
+    uint32_t deltas[POSTING_BLOCK];
+    uint32_t any = 0;
+    int base = block_base(p);
+
+    for (int i = 0; i < POSTING_BLOCK; i++) {
+        int prev = i < LANES ? base : p->tail[i - LANES];
+        deltas[i] = (uint32_t)p->tail[i] - (uint32_t)prev;
+        any |= deltas[i];
+    }
+
+    unsigned int bits = bit_width(any);
+    longtype n = (longtype)bits * LANES;
+
+    if (p->n_blocks == p->blocks_capacity) {
+        longtype cap = p->blocks_capacity ? p->blocks_capacity * 2 : 8;
+        struct posting_skip *blocks =
+            realloc(p->blocks, cap * sizeof(struct posting_skip));
+        if (blocks == NULL) {
+            return 1;
+        }
+        p->blocks = blocks;
+        p->blocks_capacity = cap;
+    }
+
+    if (p->n_words + n > p->words_capacity) {
+        longtype cap = p->words_capacity ? p->words_capacity * 2 : 256;
+        while (cap < p->n_words + n) {
+            cap *= 2;
+        }
+        uint32_t *words = realloc(p->words, cap * sizeof(uint32_t));
+        if (words == NULL) {
+            return 1;
+        }
+        p->words = words;
+        p->words_capacity = cap;
+    }
+
+    uint32_t *w = p->words + p->n_words;
+    memset(w, 0, n * sizeof(uint32_t));
+    for (int r = 0; r < ROWS; r++) {
+        unsigned int bit = (unsigned int)r * bits;
+        unsigned int k = bit / 32;
+        unsigned int shift = bit % 32;
+        for (int j = 0; j < LANES; j++) {
+            uint32_t d = deltas[r * LANES + j];
+            w[k * LANES + j] |= d << shift;
+            if (shift + bits > 32) {
+                w[(k + 1) * LANES + j] |= d >> (32 - shift);
+            }
+        }
+    }
+
+    struct posting_skip *s = &p->blocks[p->n_blocks++];
+    s->last = p->tail[POSTING_BLOCK - 1];
+    s->bits = bits;
+    s->offset = p->n_words;
+    p->n_words += n;
+    p->tail_size = 0;
+
+    return 0;
+}
+
+/* Unpack packed block 'block' into out, which holds POSTING_BLOCK values. */
+static void block_unpack(const struct posting *p, longtype block, int *out) {
+    const struct posting_skip *s = &p->blocks[block];
+    const uint32_t *w = p->words + s->offset;
+    unsigned int bits = s->bits;
+    uint32_t mask = bits == 32 ? 0xffffffffu : (1u << bits) - 1;
+    int base = block > 0 ? p->blocks[block - 1].last : 0;
+
+    /* All values equal the base, no words were stored. */
+    if (bits == 0) {
+        for (int i = 0; i < POSTING_BLOCK; i++) {
+            out[i] = base;
+        }
+        return;
+    }
+
+#ifdef __SSE2__
+    __m128i vmask = _mm_set1_epi32((int)mask);
+    __m128i prev = _mm_set1_epi32(base);
+    for (int r = 0; r < ROWS; r++) {
+        unsigned int bit = (unsigned int)r * bits;
+        unsigned int k = bit / 32;
+        unsigned int shift = bit % 32;
+        __m128i v = _mm_srl_epi32(
+            _mm_loadu_si128((const __m128i *)(w + k * LANES)),
+            _mm_cvtsi32_si128((int)shift));
+        if (shift + bits > 32) {
+            __m128i hi = _mm_loadu_si128((const __m128i *)(w + (k + 1) * LANES));
+            v = _mm_or_si128(v, _mm_sll_epi32(hi,
+                                              _mm_cvtsi32_si128((int)(32 - shift))));
+        }
+        prev = _mm_add_epi32(prev, _mm_and_si128(v, vmask));
+        _mm_storeu_si128((__m128i *)(out + r * LANES), prev);
+    }
+#else
+    uint32_t prev[LANES];
+    for (int j = 0; j < LANES; j++) {
+        prev[j] = (uint32_t)base;
+    }
+    for (int r = 0; r < ROWS; r++) {
+        unsigned int bit = (unsigned int)r * bits;
+        unsigned int k = bit / 32;
+        unsigned int shift = bit % 32;
+        for (int j = 0; j < LANES; j++) {
+            uint32_t v = w[k * LANES + j] >> shift;
+            if (shift + bits > 32) {
+                v |= w[(k + 1) * LANES + j] << (32 - shift);
+            }
+            prev[j] += v & mask;
+            out[r * LANES + j] = (int)prev[j];
+        }
+    }
+#endif
+}
+
+/* Decode block 'block' into out, the block after the packed ones is the
+ * tail. Returns the number of values decoded. */
+static longtype block_decode(const struct posting *p, longtype block,
+                             int *out) {
+    if (block < p->n_blocks) {
+        block_unpack(p, block, out);
+        return POSTING_BLOCK;
+    }
+
+    memcpy(out, p->tail, p->tail_size * sizeof(int));
+    return p->tail_size;
+}
+
+static longtype block_count(const struct posting *p) {
+    return p->n_blocks + (p->tail_size > 0);
+}
+
+struct posting *posting_from_array(const struct array *a) {
+    struct posting *p = posting_init();
+    if (p == NULL) {
+        return NULL;
+    }
+
+    longtype n = array_size(a);
+    for (longtype i = 0; i < n; i++) {
+        if (posting_append(p, array_get(a, i)) != 0) {
+            posting_cleanup(p);
+            return NULL;
+        }
+    }
+
+    return p;
+}
+
+int posting_append(struct posting *p, int value) {
+    if (p == NULL || p->view || value < 0) {
+        return 1;
+    }
+
+    int last = p->tail_size > 0 ? p->tail[p->tail_size - 1] : block_base(p);
+    if (value < last) {
+        return 1;
+    }
+
+    p->tail[p->tail_size++] = value;
+    if (p->tail_size == POSTING_BLOCK && block_pack(p) != 0) {
+        p->tail_size--;
+        return 1;
+    }
+
+    return 0;
+}
+
+unsigned long posting_size(const struct posting *p) {
+    if (p == NULL) {
+        return 0;
+    }
+
+    return p->n_blocks * POSTING_BLOCK + p->tail_size;
+}
+
+unsigned long posting_footprint(const struct posting *p) {
+    if (p == NULL) {
+        return 0;
+    }
+
+    return sizeof(struct posting) + p->words_capacity * sizeof(uint32_t) +
+           p->blocks_capacity * sizeof(struct posting_skip);
+}
+
+unsigned long posting_decode(const struct posting *p, unsigned long first,
+                             unsigned long n, int *out) {
+    int buf[POSTING_BLOCK];
+    longtype done = 0;
+    longtype size = posting_size(p);
+
+    if (first >= size) {
+        return 0;
+    }
+    if (n > size - first) {
+        n = size - first;
+    }
+
+    while (done < n) {
+        longtype index = first + done;
+        longtype block = index / POSTING_BLOCK;
+        longtype pos = index % POSTING_BLOCK;
+        longtype take = POSTING_BLOCK - pos;
+        if (take > n - done) {
+            take = n - done;
+        }
+
+        if (pos == 0 && take == POSTING_BLOCK) {
+            block_decode(p, block, out + done);
+        } else {
+            block_decode(p, block, buf);
+            memcpy(out + done, buf + pos, take * sizeof(int));
+        }
+        done += take;
+    }
+
+    return done;
+}
+
+void posting_iter_init(struct posting_iter *it, const struct posting *p) {
+    it->p = p;
+    it->block = 0;
+    it->pos = 0;
+    it->count = 0;
+}
+
+/* Decode the next block into the buffer of the iterator.
+ * Returns 1 if a block was decoded, 0 at the end of the list. */
+static int iter_load(struct posting_iter *it) {
+    if (it->p == NULL || it->block >= block_count(it->p)) {
+        return 0;
+    }
+
+    it->count = block_decode(it->p, it->block, it->buf);
+    it->pos = 0;
+    it->block++;
+    return 1;
+}
+
+int posting_iter_next(struct posting_iter *it, int *value) {
+    if (it->pos == it->count && iter_load(it) == 0) {
+        return 0;
+    }
+
+    *value = it->buf[it->pos++];
+    return 1;
+}
+
+int posting_iter_seek(struct posting_iter *it, int target, int *value) {
+    for (;;) {
+        if (it->pos < it->count && it->buf[it->count - 1] >= target) {
+            while (it->buf[it->pos] < target) {
+                it->pos++;
+            }
+            *value = it->buf[it->pos++];
+            return 1;
+        }
+
+        /* Binary search the skip entries for the first packed block that
+         * reaches target, the tail is always decoded. */
+        const struct posting *p = it->p;
+        longtype lo = it->block;
+        longtype hi = p->n_blocks;
+        if (lo < hi) {
+            while (lo < hi) {
+                longtype mid = lo + (hi - lo) / 2;
+                if (p->blocks[mid].last < target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            it->block = lo;
+        }
+
+        if (iter_load(it) == 0) {
+            return 0;
+        }
+    }
+}
+
+unsigned long posting_intersect(const struct posting *a,
+                                const struct posting *b, int *out,
+                                unsigned long max_out) {
+    struct posting_iter ia;
+    struct posting_iter ib;
+    longtype count = 0;
+    int va;
+    int vb;
+
+    posting_iter_init(&ia, a);
+    posting_iter_init(&ib, b);
+    if (posting_iter_next(&ia, &va) == 0 || posting_iter_next(&ib, &vb) == 0) {
+        return 0;
+    }
+
+    for (;;) {
+        if (va < vb) {
+            if (posting_iter_seek(&ia, vb, &va) == 0) {
+                break;
+            }
+        } else if (vb < va) {
+            if (posting_iter_seek(&ib, va, &vb) == 0) {
+                break;
+            }
+        } else {
+            if (count < max_out) {
+                out[count] = va;
+            }
+            count++;
+            if (posting_iter_next(&ia, &va) == 0 ||
+                posting_iter_next(&ib, &vb) == 0) {
+                break;
+            }
+        }
+    }
+
+    return count;
+}
+
+/* Packed lists are laid out as
+ *
+ *   skip entries | packed words | tail, padded to 8 bytes
+ *
+ * The number of packed blocks and the size of the tail follow from the
+ * number of values, so they are not stored. */
+
+unsigned long posting_packed_size(const struct posting *p) {
+    return align8(p->n_blocks * sizeof(struct posting_skip)
+                  + p->n_words * sizeof(uint32_t)
+                  + p->tail_size * sizeof(int));
+}
+
+void posting_pack(const struct posting *p, void *out) {
+    unsigned char *o = out;
+
+    /* Lists shorter than a block have no skip entries or words yet. */
+    if (p->n_blocks > 0) {
+        memcpy(o, p->blocks, p->n_blocks * sizeof(struct posting_skip));
+        o += p->n_blocks * sizeof(struct posting_skip);
+        memcpy(o, p->words, p->n_words * sizeof(uint32_t));
+        o += p->n_words * sizeof(uint32_t);
+    }
+    memcpy(o, p->tail, p->tail_size * sizeof(int));
+    o += p->tail_size * sizeof(int);
+    memset(o, 0, posting_packed_size(p) - (longtype)(o - (unsigned char *)out));
+}
+
+int posting_packed_check(const void *packed, unsigned long size,
+                         unsigned long count) {
+    const struct posting_skip *blocks = packed;
+    longtype n_blocks = count / POSTING_BLOCK;
+    longtype n_words = 0;
+
+    if (n_blocks > size / sizeof(struct posting_skip)) {
+        return 1;
+    }
+
+    /* Blocks must follow each other without gaps, so the last one tells
+     * where the words end. */
+    for (longtype i = 0; i < n_blocks; i++) {
+        if (blocks[i].bits > 32 || blocks[i].offset != n_words) {
+            return 1;
+        }
+        n_words += (longtype)blocks[i].bits * LANES;
+    }
+
+    longtype rest = size - n_blocks * sizeof(struct posting_skip);
+    return n_words > rest / sizeof(uint32_t)
+           || (count % POSTING_BLOCK) * sizeof(int)
+                  > rest - n_words * sizeof(uint32_t);
+}
+
+void posting_view(struct posting *view, const void *packed,
+                  unsigned long count) {
+    const unsigned char *b = packed;
+
+    view->n_blocks = count / POSTING_BLOCK;
+    view->blocks_capacity = 0;
+    view->blocks = (struct posting_skip *)b;
+    view->n_words = 0;
+    if (view->n_blocks > 0) {
+        const struct posting_skip *last = &view->blocks[view->n_blocks - 1];
+        view->n_words = last->offset + (longtype)last->bits * LANES;
+    }
+    view->words_capacity = 0;
+    b += view->n_blocks * sizeof(struct posting_skip);
+    view->words = (uint32_t *)b;
+    b += view->n_words * sizeof(uint32_t);
+    view->tail_size = count % POSTING_BLOCK;
+    memcpy(view->tail, b, view->tail_size * sizeof(int));
+    view->view = 1;
+}
+
+void posting_cleanup(struct posting *p) {
+    if (p == NULL) {
+        return;
+    }
+
+    free(p->words);
+    free(p->blocks);
+    free(p);
+}
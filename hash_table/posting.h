@@ -0,0 +1,123 @@
+/* Compressed posting list interface
+ * Stores a non-decreasing sequence of non-negative integers, such as the
+ * line numbers a key was inserted with, in blocks of POSTING_BLOCK values.
+ * Every full block is delta encoded and bit-packed with the smallest width
+ * that fits its deltas. Iteration and intersection decode one block at a
+ * time and use the last value of every block to skip blocks altogether.
+ *
+ * A posting list can be packed into a position independent block of memory,
+ * as frozen tables store their values (see table_freeze_flags()), and read
+ * back in place through a view. */
+
+#include <stdint.h>
+
+struct array;
+
+/* Number of values per compressed block. */
+#define POSTING_BLOCK 128
+
+/* Skip entry of a packed block, see posting.c. */
+struct posting_skip;
+
+/* Posting list data structure. The definition is public so views of packed
+ * lists can live on the stack, only access it through the functions below. */
+struct posting {
+    uint32_t *words;
+    unsigned long n_words;
+    unsigned long words_capacity;
+    struct posting_skip *blocks;
+    unsigned long n_blocks;
+    unsigned long blocks_capacity;
+    /* Values that do not fill a block yet, kept uncompressed */
+    int tail[POSTING_BLOCK];
+    unsigned long tail_size;
+    /* 1 for views, whose words and blocks belong to a packed list */
+    int view;
+};
+
+/* Iterator over a posting list. Declared here so it can live on the stack,
+ * only access it through the functions below. */
+struct posting_iter {
+    const struct posting *p;
+    /* Block decoded into buf */
+    unsigned long block;
+    /* Position of the next value in buf */
+    unsigned long pos;
+    /* Number of values in buf */
+    unsigned long count;
+    int buf[POSTING_BLOCK];
+};
+
+/* Initialise an empty posting list and return a pointer to it.
+ * Returns NULL on failure. */
+struct posting *posting_init(void);
+
+/* Build a posting list holding the values of array 'a'.
+ * Returns NULL on failure or if the values are not a non-decreasing sequence
+ * of non-negative integers. */
+struct posting *posting_from_array(const struct array *a);
+
+/* Add value at the end of the posting list. Values are buffered until a full
+ * block can be compressed.
+ * Returns 0 if successful, 1 if value is negative or smaller than the last
+ * value, if p is a view, or if an error occured. */
+int posting_append(struct posting *p, int value);
+
+/* Returns the number of values in the posting list. */
+unsigned long posting_size(const struct posting *p);
+
+/* Returns the number of bytes used by the posting list. */
+unsigned long posting_footprint(const struct posting *p);
+
+/* Decode the values with index first to first + n - 1 into 'out'.
+ * Returns the number of values decoded, which is less than n if the list
+ * ends first. */
+unsigned long posting_decode(const struct posting *p, unsigned long first,
+                             unsigned long n, int *out);
+
+/* Position the iterator at the first value of the posting list. */
+void posting_iter_init(struct posting_iter *it, const struct posting *p);
+
+/* Store the next value in '*value' and advance.
+ * Returns 1 if a value was stored, 0 at the end of the list. */
+int posting_iter_next(struct posting_iter *it, int *value);
+
+/* Advance to the first value that is at least 'target', store it in '*value'
+ * and advance past it. Blocks whose last value is below target are skipped
+ * without decoding them.
+ * Returns 1 if a value was stored, 0 if no such value is left. */
+int posting_iter_seek(struct posting_iter *it, int target, int *value);
+
+/* Intersect two posting lists. Stores at most 'max_out' common values in
+ * 'out', in increasing order, and returns the total number of common values.
+ * Duplicates count as often as they appear in both lists. */
+unsigned long posting_intersect(const struct posting *a,
+                                const struct posting *b, int *out,
+                                unsigned long max_out);
+
+/* Returns the number of bytes posting_pack() writes for p, a multiple of 8. */
+unsigned long posting_packed_size(const struct posting *p);
+
+/* Write p to 'out', which must be 8-byte aligned and hold
+ * posting_packed_size(p) bytes. The packed list holds no pointers, only the
+ * skip entries, the packed words and the tail, so it can be written to a
+ * file and mapped back on a machine with the same byte order. */
+void posting_pack(const struct posting *p, void *out);
+
+/* Check that 'size' bytes at 'packed' hold a packed list of 'count' values
+ * that a view can read without leaving them. Reads every skip entry but no
+ * packed words, for data read from a file.
+ * Returns 0 if the packed list is valid and 1 otherwise. */
+int posting_packed_check(const void *packed, unsigned long size,
+                         unsigned long count);
+
+/* Initialise 'view' as a read-only posting list over the packed list of
+ * 'count' values at 'packed', which must have been written by posting_pack()
+ * or passed posting_packed_check(). Only the tail is copied, the packed
+ * blocks are read in place and must outlive the view. Views cannot be
+ * appended to and are not cleaned up. */
+void posting_view(struct posting *view, const void *packed,
+                  unsigned long count);
+
+/* Clean up the posting list. Must not be called on views. */
+void posting_cleanup(struct posting *p);
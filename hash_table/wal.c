@@ -0,0 +1,554 @@
+/*
+ * Implements the write-ahead log. The log file is a header followed by
+ * records:
+ *
+ *   header | record | record | ...
+ *
+ * Every record holds one insert or delete and a checksum over the rest of
+ * the record. The header names the checkpoint the records apply to by the
+ * checksum of its snapshot, so a crash between writing a new snapshot and
+ * replacing the log leaves an old log behind that recovery recognises and
+ * ignores, instead of replaying its records twice.
+ *
+ * Records are appended to an in-memory buffer. A flush swaps the buffer with
+ * a spare one under a short lock and writes and syncs the swapped out buffer
+ * without holding it, so inserts only wait on the lock, never on the disk.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "array.h"
+#include "file_io.h"
+#include "frozen_table.h"
+#include "hash_func.h"
+#include "hash_table.h"
+#include "wal.h"
+
+#define WAL_MAGIC "TBLWAL1"
+
+/* Stored in the header to detect files written on a machine with a different
+ * byte order. */
+#define WAL_BYTE_ORDER 0x0102030405060708ULL
+
+/* Seed of the record checksums. */
+#define WAL_SEED 0x9e3779b97f4a7c15ULL
+
+/* Initial size of each record buffer, records that do not fit grow it. */
+#define WAL_BUFFER (64 * 1024)
+
+#define WAL_INSERT 1
+#define WAL_DELETE 2
+
+typedef unsigned long longtype;
+
+struct wal_header {
+    char magic[8];
+    uint64_t byte_order;
+    /* frozen_checksum() of the snapshot the records apply to, 0 if none */
+    uint64_t snapshot;
+};
+
+struct wal_record {
+    /* Checksum of the other fields and the key bytes */
+    uint32_t check;
+    uint32_t op;
+    uint32_t key_len;
+    int32_t value;
+    /* Followed by key_len key bytes */
+};
+
+struct wal_buffer {
+    char *data;
+    longtype used;
+    longtype capacity;
+};
+
+struct wal {
+    struct table *table;
+    char *snap_path;
+    char *log_path;
+    int fd;
+    /* Protects active, failed and stop */
+    pthread_mutex_t lock;
+    /* Held while writing to the log, keeps flushes in order */
+    pthread_mutex_t io_lock;
+    pthread_cond_t wake;
+    struct wal_buffer active;
+    /* Buffer being written, only used under io_lock */
+    struct wal_buffer spare;
+    /* 1 if records were written but not synced, only used under io_lock */
+    int unsynced;
+    /* Set once a write fails, the log no longer matches the table */
+    int failed;
+    int stop;
+    unsigned long interval_ms;
+    pthread_t flusher;
+};
+
+static uint32_t record_check(const struct wal_record *r, const char *key) {
+    uint64_t seed = hash_wy_seed((const unsigned char *)&r->op,
+                                 sizeof(*r) - sizeof(r->check), WAL_SEED);
+    return (uint32_t)hash_wy_seed((const unsigned char *)key, r->key_len, seed);
+}
+
+/* Returns a new string holding base followed by suffix, NULL on failure. */
+static char *path_join(const char *base, const char *suffix) {
+    size_t base_len = strlen(base);
+    size_t suffix_len = strlen(suffix);
+    char *path = malloc(base_len + suffix_len + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+
+    memcpy(path, base, base_len);
+    memcpy(path + base_len, suffix, suffix_len + 1);
+    return path;
+}
+
+/* Replace the log with an empty one for the snapshot with checksum
+ * 'snapshot', written to a temporary file first so a crash never leaves a
+ * log without a header behind. Returns 0 if successful and 1 otherwise. */
+static int log_create(struct wal *w, uint64_t snapshot) {
+    char *tmp_path = path_join(w->log_path, ".tmp");
+    if (tmp_path == NULL) {
+        return 1;
+    }
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp_path);
+        return 1;
+    }
+
+    struct wal_header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, WAL_MAGIC, sizeof(h.magic));
+    h.byte_order = WAL_BYTE_ORDER;
+    h.snapshot = snapshot;
+
+    if (file_write_all(fd, &h, sizeof(h)) != 0 || fdatasync(fd) != 0
+        || rename(tmp_path, w->log_path) != 0
+        || file_sync_dir(w->log_path) != 0) {
+        close(fd);
+        unlink(tmp_path);
+        free(tmp_path);
+        return 1;
+    }
+
+    free(tmp_path);
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+    w->fd = fd;
+    w->unsynced = 0;
+    return 0;
+}
+
+/* Stop accepting records, once the log no longer matches the table. */
+static void log_fail(struct wal *w) {
+    pthread_mutex_lock(&w->lock);
+    w->failed = 1;
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* Write the buffered records to the log and, if 'sync' is set, wait until
+ * everything written so far is durable.
+ * Returns 0 if successful and 1 otherwise. */
+static int log_flush(struct wal *w, int sync) {
+    pthread_mutex_lock(&w->io_lock);
+
+    pthread_mutex_lock(&w->lock);
+    struct wal_buffer full = w->active;
+    w->active = w->spare;
+    w->active.used = 0;
+    w->spare = full;
+    int result = w->failed;
+    pthread_mutex_unlock(&w->lock);
+
+    if (result == 0 && full.used > 0) {
+        result = file_write_all(w->fd, full.data, full.used);
+        w->unsynced = 1;
+    }
+    if (result == 0 && sync && w->unsynced) {
+        result = fdatasync(w->fd) != 0;
+        w->unsynced = result;
+    }
+
+    if (result != 0) {
+        log_fail(w);
+    }
+
+    pthread_mutex_unlock(&w->io_lock);
+    return result;
+}
+
+/* Append a record to the buffer, writing the buffer out first if it is full.
+ * Returns 0 if successful and 1 otherwise. */
+static int log_append(struct wal *w, uint32_t op, const char *key,
+                      longtype key_len, int value) {
+    struct wal_record r;
+    r.op = op;
+    r.key_len = (uint32_t)key_len;
+    r.value = value;
+    r.check = record_check(&r, key);
+    longtype n = sizeof(r) + key_len;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->failed && w->active.used > 0
+           && w->active.used + n > w->active.capacity) {
+        pthread_mutex_unlock(&w->lock);
+        log_flush(w, 0);
+        pthread_mutex_lock(&w->lock);
+    }
+    if (w->failed) {
+        pthread_mutex_unlock(&w->lock);
+        return 1;
+    }
+
+    if (n > w->active.capacity) {
+        char *data = realloc(w->active.data, n);
+        if (data == NULL) {
+            pthread_mutex_unlock(&w->lock);
+            return 1;
+        }
+        w->active.data = data;
+        w->active.capacity = n;
+    }
+
+    memcpy(w->active.data + w->active.used, &r, sizeof(r));
+    memcpy(w->active.data + w->active.used + sizeof(r), key, key_len);
+    w->active.used += n;
+
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+static void *flusher(void *arg) {
+    struct wal *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += w->interval_ms / 1000;
+        deadline.tv_nsec += (long)(w->interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        while (!w->stop
+               && pthread_cond_timedwait(&w->wake, &w->lock, &deadline)
+                      != ETIMEDOUT) {
+        }
+        if (w->stop) {
+            break;
+        }
+
+        pthread_mutex_unlock(&w->lock);
+        log_flush(w, 1);
+        pthread_mutex_lock(&w->lock);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+static int load_key(const char *key, unsigned long key_len,
+                    const int *values, unsigned long count, void *ctx) {
+    struct array *a = table_upsert_n(ctx, key, key_len);
+    if (a == NULL) {
+        return 1;
+    }
+
+    /* Count-only snapshots have no values, appending any value counts. */
+    for (longtype i = 0; i < count; i++) {
+        if (array_append(a, values != NULL ? values[i] : 0) != 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Load the snapshot into the table and store its checksum in '*snapshot',
+ * 0 if there is no snapshot. Returns 0 if successful and 1 otherwise. */
+static int snapshot_load(struct wal *w, uint64_t *snapshot) {
+    struct stat st;
+    *snapshot = 0;
+    if (stat(w->snap_path, &st) != 0) {
+        return errno != ENOENT;
+    }
+
+    struct frozen_table *f = frozen_load(w->snap_path);
+    if (f == NULL) {
+        return 1;
+    }
+
+    int result = frozen_foreach(f, load_key, w->table) != 0;
+    *snapshot = frozen_checksum(f);
+    frozen_cleanup(f);
+    return result;
+}
+
+/* Apply the records of a mapped log to the table, up to the first record
+ * that is incomplete or does not match its checksum.
+ * Returns the offset just past the last applied record, or 0 if an error
+ * occured. */
+static longtype log_replay(struct wal *w, const char *data, longtype size) {
+    longtype pos = sizeof(struct wal_header);
+
+    while (size - pos >= sizeof(struct wal_record)) {
+        struct wal_record r;
+        memcpy(&r, data + pos, sizeof(r));
+        const char *key = data + pos + sizeof(r);
+        if (r.key_len > size - pos - sizeof(r) || record_check(&r, key) != r.check) {
+            break;
+        }
+
+        if (r.op == WAL_INSERT) {
+            if (table_insert_n(w->table, key, r.key_len, r.value) != 0) {
+                return 0;
+            }
+        } else if (r.op == WAL_DELETE) {
+            if (table_delete_n(w->table, key, r.key_len) < 0) {
+                return 0;
+            }
+        } else {
+            break;
+        }
+        pos += sizeof(r) + r.key_len;
+    }
+
+    return pos;
+}
+
+/* Replay the log if it belongs to the snapshot with checksum 'snapshot' and
+ * keep appending to it, otherwise start a new log.
+ * Returns 0 if successful and 1 otherwise. */
+static int log_recover(struct wal *w, uint64_t snapshot) {
+    int fd = open(w->log_path, O_RDWR);
+    if (fd < 0) {
+        return errno != ENOENT || log_create(w, snapshot) != 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct wal_header)) {
+        close(fd);
+        return 1;
+    }
+
+    longtype size = (longtype)st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        close(fd);
+        return 1;
+    }
+
+    struct wal_header h;
+    memcpy(&h, data, sizeof(h));
+    if (memcmp(h.magic, WAL_MAGIC, sizeof(h.magic)) != 0
+        || h.byte_order != WAL_BYTE_ORDER
+        || (h.snapshot != snapshot && snapshot == 0)) {
+        munmap((void *)data, size);
+        close(fd);
+        return 1;
+    }
+
+    /* The log of an older snapshot is left behind by a checkpoint that
+     * crashed before replacing it, its records are in the snapshot. */
+    if (h.snapshot != snapshot) {
+        munmap((void *)data, size);
+        close(fd);
+        return log_create(w, snapshot);
+    }
+
+    longtype end = log_replay(w, data, size);
+    munmap((void *)data, size);
+
+    /* Cut off a torn tail, so new records follow the last complete one. */
+    if (end == 0 || (end < size && (ftruncate(fd, (off_t)end) != 0
+                                    || fdatasync(fd) != 0))
+        || lseek(fd, (off_t)end, SEEK_SET) < 0) {
+        close(fd);
+        return 1;
+    }
+
+    w->fd = fd;
+    return 0;
+}
+
+static void wal_free(struct wal *w) {
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+    pthread_mutex_destroy(&w->lock);
+    pthread_mutex_destroy(&w->io_lock);
+    pthread_cond_destroy(&w->wake);
+    free(w->active.data);
+    free(w->spare.data);
+    free(w->snap_path);
+    free(w->log_path);
+    free(w);
+}
+
+struct wal *wal_open(const char *base, struct table *t,
+                     unsigned long flush_interval_ms) {
+    if (base == NULL || t == NULL) {
+        return NULL;
+    }
+
+    struct wal *w = calloc(1, sizeof(struct wal));
+    if (w == NULL) {
+        return NULL;
+    }
+
+    w->table = t;
+    w->fd = -1;
+    w->interval_ms = flush_interval_ms;
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_mutex_init(&w->io_lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    w->snap_path = path_join(base, ".snap");
+    w->log_path = path_join(base, ".log");
+    w->active.data = malloc(WAL_BUFFER);
+    w->spare.data = malloc(WAL_BUFFER);
+    w->active.capacity = WAL_BUFFER;
+    w->spare.capacity = WAL_BUFFER;
+
+    uint64_t snapshot;
+    if (w->snap_path == NULL || w->log_path == NULL || w->active.data == NULL
+        || w->spare.data == NULL || snapshot_load(w, &snapshot) != 0
+        || log_recover(w, snapshot) != 0) {
+        wal_free(w);
+        return NULL;
+    }
+
+    if (flush_interval_ms > 0
+        && pthread_create(&w->flusher, NULL, flusher, w) != 0) {
+        wal_free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+int wal_insert(struct wal *w, const char *key, int value) {
+    if (w == NULL || key == NULL) {
+        return 1;
+    }
+
+    /* The record goes first, so the table never holds a change that the
+     * log cannot recover. */
+    longtype key_len = strlen(key);
+    if (key_len > UINT32_MAX
+        || log_append(w, WAL_INSERT, key, key_len, value) != 0) {
+        return 1;
+    }
+
+    if (table_insert_n(w->table, key, key_len, value) != 0) {
+        log_fail(w);
+        return 1;
+    }
+
+    return 0;
+}
+
+int wal_delete(struct wal *w, const char *key) {
+    if (w == NULL || key == NULL) {
+        return -1;
+    }
+
+    /* Only deletes of present keys are logged, and the record goes first
+     * as in wal_insert(). */
+    longtype key_len = strlen(key);
+    if (table_lookup_n(w->table, key, key_len) == NULL) {
+        return 1;
+    }
+    if (log_append(w, WAL_DELETE, key, key_len, 0) != 0) {
+        return -1;
+    }
+
+    if (table_delete_n(w->table, key, key_len) != 0) {
+        log_fail(w);
+        return -1;
+    }
+
+    return 0;
+}
+
+int wal_sync(struct wal *w) {
+    if (w == NULL) {
+        return 1;
+    }
+
+    return log_flush(w, 1);
+}
+
+int wal_checkpoint(struct wal *w) {
+    if (w == NULL) {
+        return 1;
+    }
+
+    /* Write the buffered records to the old log first, so it is complete if
+     * the snapshot cannot be written. */
+    if (log_flush(w, 0) != 0) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&w->io_lock);
+
+    int result = 1;
+    struct frozen_table *f = table_freeze(w->table);
+    if (f != NULL) {
+        uint64_t snapshot = frozen_checksum(f);
+        /* Once the new snapshot has replaced the old one, the old log no
+         * longer belongs to the checkpoint on disk and recovery would drop
+         * any record appended to it from now on. A new log is only started
+         * once the rename is durable, as a crash could otherwise bring back
+         * the old snapshot next to a log of the new one. If the snapshot was
+         * replaced but either step failed, the log stops accepting
+         * records. */
+        int saved = frozen_save(f, w->snap_path);
+        if (saved == 0) {
+            result = log_create(w, snapshot);
+        }
+        if (saved == 2 || (saved == 0 && result != 0)) {
+            log_fail(w);
+        }
+        frozen_cleanup(f);
+    }
+
+    pthread_mutex_unlock(&w->io_lock);
+    return result;
+}
+
+int wal_close(struct wal *w) {
+    if (w == NULL) {
+        return 1;
+    }
+
+    if (w->interval_ms > 0) {
+        pthread_mutex_lock(&w->lock);
+        w->stop = 1;
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->flusher, NULL);
+    }
+
+    int result = log_flush(w, 1);
+    wal_free(w);
+    return result;
+}
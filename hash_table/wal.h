@@ -0,0 +1,63 @@
+/* Write-ahead log interface
+ * Optional durability layer around a struct table. wal_insert() and
+ * wal_delete() append a record of a change to a log file, then change the
+ * table. Records are collected in a buffer and written to the end of the log
+ * in order, and the log is made durable with one fdatasync() for all records
+ * of a flush interval (group commit), never once per record. A crash loses
+ * at most the records of the last interval.
+ *
+ * The table is stored as two files: base.snap, the last checkpoint written
+ * by wal_checkpoint() as a frozen table snapshot (see frozen_table.h), and
+ * base.log, the records appended since. wal_open() loads the checkpoint and
+ * replays the log on top of it. A record that was only partly written when
+ * the process died is detected by its checksum and dropped, together with
+ * anything after it.
+ *
+ * Build with -pthread. */
+
+struct table;
+
+/* Handle to write-ahead log data structure. */
+struct wal;
+
+/* Recover the table stored under the path prefix 'base' into the empty table
+ * 't' and return a log that records all further changes to it. Missing files
+ * are created, so a new base starts out empty. Every 'flush_interval_ms'
+ * milliseconds a background thread writes the buffered records and syncs the
+ * log. An interval of 0 starts no thread: records are then written when the
+ * buffer fills up and only synced by wal_sync(), wal_checkpoint() and
+ * wal_close(). The table may be read directly, but must only be changed
+ * through the log, from one thread at a time.
+ * Returns NULL on failure, or if the files are not a valid checkpoint and
+ * log. */
+struct wal *wal_open(const char *base, struct table *t,
+                     unsigned long flush_interval_ms);
+
+/* Appends a record of the insert to the log, then does the same as
+ * table_insert(). If the table cannot be changed after the record was
+ * appended, the log stops accepting records, as it no longer matches the
+ * table.
+ * Returns 0 if successful and 1 otherwise. */
+int wal_insert(struct wal *w, const char *key, int value);
+
+/* Same as table_delete(), but if the key is present a record of the delete
+ * is appended to the log before it is removed, as in wal_insert().
+ * Returns 0 if the key was removed, 1 if it was not present and -1 if an
+ * error occured. */
+int wal_delete(struct wal *w, const char *key);
+
+/* Write all buffered records and wait until the log is durable.
+ * Returns 0 if successful and 1 otherwise. */
+int wal_sync(struct wal *w);
+
+/* Write a snapshot of the table to base.snap and start a new, empty log.
+ * If the snapshot cannot be written, the old checkpoint and log stay valid.
+ * If it was written but the new log cannot be started, the log stops
+ * accepting records and wal_insert() and wal_delete() fail from then on.
+ * Returns 0 if successful and 1 otherwise. */
+int wal_checkpoint(struct wal *w);
+
+/* Sync the log, stop the background thread and free the log. The table is
+ * left to the caller.
+ * Returns 0 if all records were made durable and 1 otherwise. */
+int wal_close(struct wal *w);
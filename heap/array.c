@@ -2,7 +2,10 @@
  * Implements a dynamic array structure.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
+#include <string.h>
 
 #include "array.h"
 
@@ -10,8 +13,28 @@ struct array {
     void **data;
     long size;
     long capacity;
+    /* Start of the allocation, 'pad' slots before data */
+    void **base;
+    long pad;
+    /* Alignment of base in bytes, 0 if the storage is not aligned */
+    long align;
 };
 
+/* Allocate room for 'capacity' elements plus the padding of 'a', aligned if
+ * 'a' is. Return NULL if an error occurred. */
+static void **array_alloc(const struct array *a, long capacity) {
+    unsigned long bytes = (unsigned long) (capacity + a->pad) * sizeof(void *);
+    if (a->align == 0) {
+        return malloc(bytes);
+    }
+
+    void *p;
+    if (posix_memalign(&p, (unsigned long) a->align, bytes) != 0) {
+        return NULL;
+    }
+    return p;
+}
+
 struct array *array_init(long initial_capacity) {
     struct array *a = malloc(sizeof(struct array));
     if (a == NULL) {
@@ -20,11 +43,40 @@ struct array *array_init(long initial_capacity) {
     if (initial_capacity == 0) {
         initial_capacity = 1;
     }
-    a->data = (void **) malloc((unsigned long) initial_capacity * sizeof(void *));
-    if (a->data == NULL) {
+    a->pad = 0;
+    a->align = 0;
+    a->base = array_alloc(a, initial_capacity);
+    if (a->base == NULL) {
         free(a);
         return NULL;
     }
+    a->data = a->base;
+    a->size = 0;
+    a->capacity = initial_capacity;
+    return a;
+}
+
+struct array *array_init_aligned(long initial_capacity, long align, long pad) {
+    if (align <= 0 || (align & (align - 1)) != 0
+        || align % (long) sizeof(void *) != 0 || pad < 0) {
+        return NULL;
+    }
+
+    struct array *a = malloc(sizeof(struct array));
+    if (a == NULL) {
+        return NULL;
+    }
+    if (initial_capacity == 0) {
+        initial_capacity = 1;
+    }
+    a->pad = pad;
+    a->align = align;
+    a->base = array_alloc(a, initial_capacity);
+    if (a->base == NULL) {
+        free(a);
+        return NULL;
+    }
+    a->data = a->base + pad;
     a->size = 0;
     a->capacity = initial_capacity;
     return a;
@@ -44,7 +96,7 @@ void array_cleanup(struct array *a, void (*free_func)(void *)) {
         free_func(e);
     }
 
-    free(a->data);
+    free(a->base);
     free(a);
 }
 
@@ -72,12 +124,24 @@ int array_append(struct array *a, void *p) {
 
     if (a->size == a->capacity) {
         long new_capacity = (a->capacity + 1) * 2;
-        void **new = realloc(a->data, (unsigned long) new_capacity * sizeof(void *));
-        if (new == NULL) {
-            return -1;
+        void **new;
+        if (a->align == 0) {
+            new = realloc(a->base, (unsigned long) new_capacity * sizeof(void *));
+            if (new == NULL) {
+                return -1;
+            }
+        } else {
+            /* realloc() does not keep the alignment. */
+            new = array_alloc(a, new_capacity);
+            if (new == NULL) {
+                return -1;
+            }
+            memcpy(new + a->pad, a->data, (unsigned long) a->size * sizeof(void *));
+            free(a->base);
         }
         a->capacity = new_capacity;
-        a->data = new;
+        a->base = new;
+        a->data = new + a->pad;
     }
 
     a->size++;
@@ -94,6 +158,14 @@ void *array_pop(struct array *a) {
     return last;
 }
 
+void **array_data(struct array *a) {
+    if (a == NULL) {
+        return NULL;
+    }
+
+    return a->data;
+}
+
 long int array_size(const struct array *a) {
     if (a == NULL) {
         return -1;
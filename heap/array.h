@@ -8,6 +8,14 @@ struct array;
  * Return NULL if an error occured. */
 struct array *array_init(long initial_capacity);
 
+/* Same as array_init(), but the storage starts on an 'align' byte boundary,
+ * followed by 'pad' unused slots and then the elements, so element i lives
+ * (pad + i) * sizeof(void *) bytes past an aligned address. The alignment
+ * is kept when the array grows. 'align' must be a power of two and a
+ * multiple of sizeof(void *).
+ * Return NULL if an error occured. */
+struct array *array_init_aligned(long initial_capacity, long align, long pad);
+
 /* Free all elements stored in the array 'a' using the 'free_func()'
  * parameter, then free the array itself. If 'free_func' is NULL the
  * standard free() is used. */
@@ -28,6 +36,11 @@ int array_append(struct array *a, void *p);
  * Return NULL if 'a' is empty. */
 void *array_pop(struct array *a);
 
+/* Return a pointer to the elements of array 'a', element i at index i,
+ * without bounds checks. The pointer is valid until the array grows.
+ * Return NULL if an error occurred. */
+void **array_data(struct array *a);
+
 /* Return the size of array 'a'.
  * Return -1 if an error occured. */
 long int array_size(const struct array *a);
@@ -0,0 +1,499 @@
+/*
+ * Benchmark of the monotone priority queues in radix_heap.c against prioq.
+ *
+ * Runs two monotone workloads on each queue. The hold model of event
+ * simulations fills the queue with 'size' events, then every operation pops
+ * the event with the smallest time and schedules it again at a random time
+ * 1 to 'increment' after the popped one. The queue size stays constant and
+ * popped times never decrease. All queues see the same sequence of times,
+ * so they report the same checksum.
+ *
+ * Dijkstra's algorithm computes the distances from vertex 0 in a random
+ * directed graph of 'size' vertices with DEGREE edges each and integer
+ * weights 1 to 'increment'. Distances are never decreased inside a queue: a
+ * shorter distance is inserted as a new element and the outdated one is
+ * skipped when it is popped. The checksum is the sum of all distances, the
+ * same for every queue, and ns/op is the time per pop.
+ *
+ * Build:
+ *   gcc -O2 -o bench_radix bench_radix.c radix_heap.c heap.c array.c
+ *
+ * Usage: bench_radix [-n ops] [-s size] [-c increment]
+ *   -n  number of pop and insert pairs of the hold model (default 10000000)
+ *   -s  number of events in the queue, and of vertices in the graph
+ *       (default 1000000)
+ *   -c  largest time increment and edge weight (default 1000)
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "prioq.h"
+#include "radix_heap.h"
+
+#define DEFAULT_OPS 10000000
+#define DEFAULT_SIZE 1000000
+#define DEFAULT_INCREMENT 1000
+
+/* Number of edges leaving every vertex of the Dijkstra graph. */
+#define DEGREE 4
+
+struct event {
+    unsigned long time;
+};
+
+struct result {
+    double seconds;
+    unsigned long checksum;
+    /* Number of pops, for workloads where it is not given up front */
+    unsigned long ops;
+};
+
+/* A tentative distance of a vertex, inserted whenever it improves. */
+struct visit {
+    unsigned long dist;
+    uint32_t vertex;
+};
+
+/* Random directed graph in compressed form: vertex v has the DEGREE edges
+ * starting at index v * DEGREE of 'target' and 'weight'. */
+struct graph {
+    unsigned long n_vertices;
+    uint32_t *target;
+    uint32_t *weight;
+    /* Shortest distance found so far, ULONG_MAX if the vertex was not
+     * reached yet */
+    unsigned long *dist;
+    /* Elements handed to the queues. Every insert but the first follows an
+     * improved distance over an edge, so one per edge and one for vertex 0
+     * are always enough. */
+    struct visit *visits;
+    unsigned long n_visits;
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Cheap xorshift generator, so every queue sees the same times. */
+static unsigned long next_random(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* The events belong to the caller, so the queues never free them. */
+static void keep_event(void *p) {
+    (void)p;
+}
+
+static int compare_events(const void *a, const void *b) {
+    unsigned long x = ((const struct event *)a)->time;
+    unsigned long y = ((const struct event *)b)->time;
+    return (x > y) - (x < y);
+}
+
+/* Give every event its first time, the same for every queue. */
+static void events_reset(struct event *events, unsigned long size,
+                         unsigned long increment, unsigned long *state) {
+    *state = 0x2545f4914f6cdd1dUL;
+    for (unsigned long i = 0; i < size; i++) {
+        events[i].time = next_random(state) % increment;
+    }
+}
+
+static int compare_visits(const void *a, const void *b) {
+    unsigned long x = ((const struct visit *)a)->dist;
+    unsigned long y = ((const struct visit *)b)->dist;
+    return (x > y) - (x < y);
+}
+
+/* Build a random graph with weights 1 to 'increment'.
+ * Returns 0 if successful and 1 otherwise. */
+static int graph_init(struct graph *g, unsigned long n_vertices,
+                      unsigned long increment) {
+    unsigned long n_edges = n_vertices * DEGREE;
+    unsigned long state = 0x9e3779b97f4a7c15UL;
+
+    g->n_vertices = n_vertices;
+    g->target = malloc(n_edges * sizeof(uint32_t));
+    g->weight = malloc(n_edges * sizeof(uint32_t));
+    g->dist = malloc(n_vertices * sizeof(unsigned long));
+    g->visits = malloc((n_edges + 1) * sizeof(struct visit));
+    if (g->target == NULL || g->weight == NULL || g->dist == NULL
+        || g->visits == NULL) {
+        return 1;
+    }
+
+    for (unsigned long i = 0; i < n_edges; i++) {
+        g->target[i] = (uint32_t)(next_random(&state) % n_vertices);
+        g->weight[i] = (uint32_t)(1 + next_random(&state) % increment);
+    }
+    return 0;
+}
+
+static void graph_cleanup(struct graph *g) {
+    free(g->target);
+    free(g->weight);
+    free(g->dist);
+    free(g->visits);
+}
+
+/* Forget all distances and return the visit of vertex 0 at distance 0. */
+static struct visit *graph_reset(struct graph *g) {
+    for (unsigned long v = 0; v < g->n_vertices; v++) {
+        g->dist[v] = ULONG_MAX;
+    }
+    g->dist[0] = 0;
+    g->n_visits = 1;
+    g->visits[0].dist = 0;
+    g->visits[0].vertex = 0;
+    return &g->visits[0];
+}
+
+/* Relax edge i of the vertex of 'from'. Returns the new visit of the edge
+ * target if the edge shortens its distance, NULL otherwise. */
+static struct visit *graph_relax(struct graph *g, const struct visit *from,
+                                 unsigned long i) {
+    unsigned long e = (unsigned long)from->vertex * DEGREE + i;
+    unsigned long dist = from->dist + g->weight[e];
+    uint32_t to = g->target[e];
+    if (dist >= g->dist[to]) {
+        return NULL;
+    }
+
+    g->dist[to] = dist;
+    struct visit *v = &g->visits[g->n_visits++];
+    v->dist = dist;
+    v->vertex = to;
+    return v;
+}
+
+/* Sum of the distances of all reached vertices. */
+static unsigned long graph_checksum(const struct graph *g) {
+    unsigned long sum = 0;
+    for (unsigned long v = 0; v < g->n_vertices; v++) {
+        if (g->dist[v] != ULONG_MAX) {
+            sum += g->dist[v];
+        }
+    }
+    return sum;
+}
+
+static int run_prioq(struct event *events, unsigned long size,
+                     unsigned long ops, unsigned long increment,
+                     struct result *r) {
+    unsigned long state;
+    events_reset(events, size, increment, &state);
+
+    double start = now();
+    prioq *q = prioq_init(compare_events);
+    if (q == NULL) {
+        return 1;
+    }
+    for (unsigned long i = 0; i < size; i++) {
+        if (prioq_insert(q, &events[i]) != 0) {
+            prioq_cleanup(q, keep_event);
+            return 1;
+        }
+    }
+
+    r->checksum = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        struct event *e = prioq_pop(q);
+        r->checksum += e->time;
+        e->time += 1 + next_random(&state) % increment;
+        if (prioq_insert(q, e) != 0) {
+            prioq_cleanup(q, keep_event);
+            return 1;
+        }
+    }
+    r->seconds = now() - start;
+
+    prioq_cleanup(q, keep_event);
+    return 0;
+}
+
+static int run_radix(struct event *events, unsigned long size,
+                     unsigned long ops, unsigned long increment,
+                     struct result *r) {
+    unsigned long state;
+    events_reset(events, size, increment, &state);
+
+    double start = now();
+    struct radix_heap *h = radix_heap_init();
+    if (h == NULL) {
+        return 1;
+    }
+    for (unsigned long i = 0; i < size; i++) {
+        if (radix_heap_insert(h, events[i].time, &events[i]) != 0) {
+            radix_heap_cleanup(h, keep_event);
+            return 1;
+        }
+    }
+
+    r->checksum = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        unsigned long time;
+        struct event *e = radix_heap_pop(h, &time);
+        r->checksum += time;
+        e->time = time + 1 + next_random(&state) % increment;
+        if (radix_heap_insert(h, e->time, e) != 0) {
+            radix_heap_cleanup(h, keep_event);
+            return 1;
+        }
+    }
+    r->seconds = now() - start;
+
+    radix_heap_cleanup(h, keep_event);
+    return 0;
+}
+
+static int run_bucket(struct event *events, unsigned long size,
+                      unsigned long ops, unsigned long increment,
+                      struct result *r) {
+    unsigned long state;
+    events_reset(events, size, increment, &state);
+
+    double start = now();
+    struct bucket_queue *q = bucket_queue_init(increment + 1);
+    if (q == NULL) {
+        return 1;
+    }
+    for (unsigned long i = 0; i < size; i++) {
+        if (bucket_queue_insert(q, events[i].time, &events[i]) != 0) {
+            bucket_queue_cleanup(q, keep_event);
+            return 1;
+        }
+    }
+
+    r->checksum = 0;
+    for (unsigned long i = 0; i < ops; i++) {
+        unsigned long time;
+        struct event *e = bucket_queue_pop(q, &time);
+        r->checksum += time;
+        e->time = time + 1 + next_random(&state) % increment;
+        if (bucket_queue_insert(q, e->time, e) != 0) {
+            bucket_queue_cleanup(q, keep_event);
+            return 1;
+        }
+    }
+    r->seconds = now() - start;
+
+    bucket_queue_cleanup(q, keep_event);
+    return 0;
+}
+
+static int dijkstra_prioq(struct graph *g, unsigned long increment,
+                          struct result *r) {
+    (void)increment;
+    struct visit *source = graph_reset(g);
+
+    double start = now();
+    prioq *q = prioq_init(compare_visits);
+    if (q == NULL || prioq_insert(q, source) != 0) {
+        prioq_cleanup(q, keep_event);
+        return 1;
+    }
+
+    r->ops = 0;
+    while (prioq_size(q) > 0) {
+        struct visit *v = prioq_pop(q);
+        r->ops++;
+        if (v->dist > g->dist[v->vertex]) {
+            /* A shorter distance was popped before. */
+            continue;
+        }
+        for (unsigned long i = 0; i < DEGREE; i++) {
+            struct visit *next = graph_relax(g, v, i);
+            if (next != NULL && prioq_insert(q, next) != 0) {
+                prioq_cleanup(q, keep_event);
+                return 1;
+            }
+        }
+    }
+    r->seconds = now() - start;
+    r->checksum = graph_checksum(g);
+
+    prioq_cleanup(q, keep_event);
+    return 0;
+}
+
+static int dijkstra_radix(struct graph *g, unsigned long increment,
+                          struct result *r) {
+    (void)increment;
+    struct visit *source = graph_reset(g);
+
+    double start = now();
+    struct radix_heap *h = radix_heap_init();
+    if (h == NULL || radix_heap_insert(h, 0, source) != 0) {
+        radix_heap_cleanup(h, keep_event);
+        return 1;
+    }
+
+    r->ops = 0;
+    while (radix_heap_size(h) > 0) {
+        struct visit *v = radix_heap_pop(h, NULL);
+        r->ops++;
+        if (v->dist > g->dist[v->vertex]) {
+            continue;
+        }
+        for (unsigned long i = 0; i < DEGREE; i++) {
+            struct visit *next = graph_relax(g, v, i);
+            if (next != NULL && radix_heap_insert(h, next->dist, next) != 0) {
+                radix_heap_cleanup(h, keep_event);
+                return 1;
+            }
+        }
+    }
+    r->seconds = now() - start;
+    r->checksum = graph_checksum(g);
+
+    radix_heap_cleanup(h, keep_event);
+    return 0;
+}
+
+/* Inserted distances are at most the largest weight above the popped one,
+ * so a range of 'increment' + 1 buckets is enough. */
+static int dijkstra_bucket(struct graph *g, unsigned long increment,
+                           struct result *r) {
+    struct visit *source = graph_reset(g);
+
+    double start = now();
+    struct bucket_queue *q = bucket_queue_init(increment + 1);
+    if (q == NULL || bucket_queue_insert(q, 0, source) != 0) {
+        bucket_queue_cleanup(q, keep_event);
+        return 1;
+    }
+
+    r->ops = 0;
+    while (bucket_queue_size(q) > 0) {
+        struct visit *v = bucket_queue_pop(q, NULL);
+        r->ops++;
+        if (v->dist > g->dist[v->vertex]) {
+            continue;
+        }
+        for (unsigned long i = 0; i < DEGREE; i++) {
+            struct visit *next = graph_relax(g, v, i);
+            if (next != NULL
+                && bucket_queue_insert(q, next->dist, next) != 0) {
+                bucket_queue_cleanup(q, keep_event);
+                return 1;
+            }
+        }
+    }
+    r->seconds = now() - start;
+    r->checksum = graph_checksum(g);
+
+    bucket_queue_cleanup(q, keep_event);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long ops = DEFAULT_OPS;
+    unsigned long size = DEFAULT_SIZE;
+    unsigned long increment = DEFAULT_INCREMENT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:c:")) != -1) {
+        switch (opt) {
+        case 'n':
+            ops = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            size = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            increment = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n ops] [-s size] [-c increment]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (size == 0 || increment == 0) {
+        fprintf(stderr, "size and increment must be positive\n");
+        return EXIT_FAILURE;
+    }
+    if (size > UINT32_MAX || increment > UINT32_MAX) {
+        fprintf(stderr, "size and increment must fit in 32 bits\n");
+        return EXIT_FAILURE;
+    }
+
+    struct event *events = malloc(size * sizeof(struct event));
+    if (events == NULL) {
+        fprintf(stderr, "could not allocate events\n");
+        return EXIT_FAILURE;
+    }
+
+    static const struct {
+        const char *name;
+        int (*run)(struct event *, unsigned long, unsigned long,
+                   unsigned long, struct result *);
+    } queues[] = {
+        {"prioq", run_prioq},
+        {"radix_heap", run_radix},
+        {"bucket_queue", run_bucket},
+    };
+
+    printf("%lu events, %lu ops, increment 1 to %lu\n", size, ops, increment);
+    printf("%-15s %10s %10s   %s\n", "queue", "seconds", "ns/op", "checksum");
+    for (unsigned long i = 0; i < sizeof(queues) / sizeof(queues[0]); i++) {
+        struct result r;
+        if (queues[i].run(events, size, ops, increment, &r) != 0) {
+            fprintf(stderr, "%s: out of memory\n", queues[i].name);
+            free(events);
+            return EXIT_FAILURE;
+        }
+
+        printf("%-15s %10.3f %10.1f   %lu\n", queues[i].name, r.seconds,
+               ops > 0 ? r.seconds * 1e9 / (double)ops : 0.0, r.checksum);
+    }
+    free(events);
+
+    struct graph g;
+    if (graph_init(&g, size, increment) != 0) {
+        fprintf(stderr, "could not allocate graph\n");
+        graph_cleanup(&g);
+        return EXIT_FAILURE;
+    }
+
+    printf("\ndijkstra: %lu vertices, %lu edges, weights 1 to %lu\n", size,
+           size * DEGREE, increment);
+    printf("%-15s %10s %10s   %s\n", "queue", "seconds", "ns/op", "checksum");
+    static const struct {
+        const char *name;
+        int (*run)(struct graph *, unsigned long, struct result *);
+    } searches[] = {
+        {"prioq", dijkstra_prioq},
+        {"radix_heap", dijkstra_radix},
+        {"bucket_queue", dijkstra_bucket},
+    };
+
+    for (unsigned long i = 0; i < sizeof(searches) / sizeof(searches[0]);
+         i++) {
+        struct result r;
+        if (searches[i].run(&g, increment, &r) != 0) {
+            fprintf(stderr, "%s: out of memory\n", searches[i].name);
+            graph_cleanup(&g);
+            return EXIT_FAILURE;
+        }
+
+        printf("%-15s %10.3f %10.1f   %lu\n", searches[i].name, r.seconds,
+               r.ops > 0 ? r.seconds * 1e9 / (double)r.ops : 0.0, r.checksum);
+    }
+
+    graph_cleanup(&g);
+    return EXIT_SUCCESS;
+}
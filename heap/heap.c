@@ -2,6 +2,11 @@
  * Manages a  heap-based priority queue, with functions for initialisation,
  * popping, insertion etc. It also uses a dynamically sized array and custom
  * compare function.
+ *
+ * The heap is d-ary: node i has children d * i + 1 ... d * i + d. Element i
+ * is stored d - 1 slots past a cache line aligned address, which starts every
+ * group of siblings on a multiple of d slots. For a power of two d of at most
+ * CACHE_LINE / sizeof(void *) no group straddles a cache line.
  */
 
 #include <math.h>
@@ -13,17 +18,24 @@
 
 #define SIZE_ARRAY 100
 
+#define CACHE_LINE 64
+
 typedef long int longtype;
 
 /* prioq.h, prioq_init comment applies. Same goes for the rest of the funcs.*/
-static struct heap *heap_init(int (*compare)(const void *, const void *)) {
+static struct heap *heap_init(int (*compare)(const void *, const void *),
+                              longtype d, longtype capacity) {
+    if (d < 2) {
+        return NULL;
+    }
 
     struct heap *h = malloc(sizeof(struct heap));
     if (h == NULL) {
         return NULL;
     }
 
-    h->array = array_init(SIZE_ARRAY);
+    h->d = d;
+    h->array = array_init_aligned(capacity, CACHE_LINE, d - 1);
     if (h->array == NULL) {
         free(h);
         return NULL;
@@ -34,7 +46,11 @@ static struct heap *heap_init(int (*compare)(const void *, const void *)) {
 }
 
 prioq *prioq_init(int (*compare)(const void *, const void *)) {
-    prioq *q = heap_init(compare);
+    return prioq_init_dary(compare, PRIOQ_ARITY);
+}
+
+prioq *prioq_init_dary(int (*compare)(const void *, const void *), long int d) {
+    prioq *q = heap_init(compare, d, SIZE_ARRAY);
     if (q == NULL) {
         return NULL;
     }
@@ -69,6 +85,69 @@ int prioq_cleanup(prioq *q, void free_func(void *)) {
     return 0;
 }
 
+/* Move a hole at position 'hole' towards the root until p fits, then store p
+ * there. Moving a hole instead of swapping writes every level only once. */
+static void sift_up(const struct heap *h, void **data, longtype hole,
+                    void *p) {
+    while (hole > 0) {
+        longtype parent = (hole - 1) / h->d;
+        if (h->compare(p, data[parent]) >= 0) {
+            break;
+        }
+        data[hole] = data[parent];
+        hole = parent;
+    }
+    data[hole] = p;
+}
+
+/* Move a hole at position 'hole' towards the leaves of a heap of 'size'
+ * elements until p fits, pulling the smallest child up at every level, then
+ * store p there. All children of a node share a cache line, so a level costs
+ * at most one miss. */
+static void sift_down(const struct heap *h, void **data, longtype size,
+                      longtype hole, void *p) {
+    longtype d = h->d;
+
+    while (1) {
+        longtype first_child = hole * d + 1;
+        if (first_child >= size) {
+            break;
+        }
+
+        longtype end_child = first_child + d < size ? first_child + d : size;
+        longtype child_smallest = first_child;
+        for (longtype child = first_child + 1; child < end_child; child++) {
+            if (h->compare(data[child], data[child_smallest]) < 0) {
+                child_smallest = child;
+            }
+        }
+
+        if (h->compare(data[child_smallest], p) >= 0) {
+            break;
+        }
+        data[hole] = data[child_smallest];
+        hole = child_smallest;
+    }
+    data[hole] = p;
+}
+
+/* Restore the heap order of the whole array bottom-up (Floyd): sift down
+ * every node that has children, last first. Every subtree is a heap by the
+ * time its root is sifted, and most nodes sit near the leaves, so this takes
+ * O(n) compares in total. */
+static void heapify(struct heap *h) {
+    void **data = array_data(h->array);
+    longtype size = array_size(h->array);
+
+    if (size < 2) {
+        return;
+    }
+
+    for (longtype i = (size - 2) / h->d; i >= 0; i--) {
+        sift_down(h, data, size, i, data[i]);
+    }
+}
+
 static int heap_insert(struct heap *h, void *p) {
     if (h == NULL || p == NULL) {
         return -1;
@@ -78,26 +157,69 @@ static int heap_insert(struct heap *h, void *p) {
         return -1;
     }
 
-    longtype root = 0;
-    longtype inserted_node = array_size(h->array) - 1;
-    longtype parent_node = (inserted_node - 1) / 2;
+    sift_up(h, array_data(h->array), array_size(h->array) - 1, p);
+    return 0;
+}
+
+prioq *prioq_init_from(void **elements, long int n,
+                       int (*compare)(const void *, const void *)) {
+    if (n < 0 || (elements == NULL && n > 0)) {
+        return NULL;
+    }
+
+    prioq *q = heap_init(compare, PRIOQ_ARITY, n > SIZE_ARRAY ? n : SIZE_ARRAY);
+    if (q == NULL) {
+        return NULL;
+    }
+
+    if (prioq_insert_many(q, elements, n) != 0) {
+        array_cleanup(q->array, NULL);
+        free(q);
+        return NULL;
+    }
+
+    return q;
+}
 
-    while (inserted_node > root && h->compare(array_get(h->array, inserted_node),
-             array_get(h->array, parent_node)) < 0) {
-        void *temp = array_get(h->array, inserted_node);
+int prioq_insert_many(prioq *q, void **elements, long int n) {
+    if (q == NULL || n < 0 || (elements == NULL && n > 0)) {
+        return -1;
+    }
 
+    for (longtype i = 0; i < n; i++) {
+        if (elements[i] == NULL) {
+            return -1;
+        }
+    }
 
-        void *inserted_ptr = array_get(h->array, inserted_node);
-        void *parent_ptr = array_get(h->array, parent_node);
-        if (inserted_ptr == NULL || parent_ptr == NULL) {
+    longtype old_size = array_size(q->array);
+    for (longtype i = 0; i < n; i++) {
+        if (array_append(q->array, elements[i]) != 0) {
+            /* Leave the queue as it was. */
+            while (array_size(q->array) > old_size) {
+                array_pop(q->array);
+            }
             return -1;
         }
+    }
 
-        array_set(h->array, inserted_node, array_get(h->array, parent_node));
-        array_set(h->array, parent_node, temp);
+    /* Sifting up every new element costs up to one compare per level of
+     * the heap each, rebuilding costs about d / (d - 1) compares per element
+     * of the whole heap. Rebuild if the batch is large enough. */
+    longtype size = old_size + n;
+    longtype levels = 1;
+    for (longtype span = q->d; span < size; span *= q->d) {
+        levels++;
+    }
+
+    if (n * levels >= size) {
+        heapify(q);
+        return 0;
+    }
 
-        inserted_node = parent_node;
-        parent_node = (inserted_node - 1) / 2;
+    void **data = array_data(q->array);
+    for (longtype i = old_size; i < size; i++) {
+        sift_up(q, data, i, data[i]);
     }
 
     return 0;
@@ -108,8 +230,7 @@ int prioq_insert(prioq *q, void *p) {
         return -1;
     }
 
-    heap_insert(q, p);
-    return 0;
+    return heap_insert(q, p);
 }
 
 static void *heap_pop(struct heap *h) {
@@ -117,40 +238,14 @@ static void *heap_pop(struct heap *h) {
         return NULL;
     }
 
-    void *root_node = array_get(h->array, 0);
+    void **data = array_data(h->array);
+    void *root_node = data[0];
     void *last_node = array_pop(h->array);
+    longtype size = array_size(h->array);
 
-    if (array_size(h->array) > 0) {
-        array_set(h->array, 0, last_node);
-
-        longtype index = 0;
-        while (1) {
-            longtype child_left = index * 2 + 1;
-            longtype child_right = index * 2 + 2;
-            longtype child_smallest = index;
-            if (child_left < array_size(h->array)) {
-                void *childLeftValue = array_get(h->array, child_left);
-                if (childLeftValue != NULL && h->compare(childLeftValue, array_get(h->array, index)) < 0) {
-                    child_smallest = child_left;
-                }
-            }
-
-            if (child_right < array_size(h->array)) {
-                void *childRightValue = array_get(h->array, child_right);
-                if (childRightValue != NULL && h->compare(childRightValue, array_get(h->array, child_smallest)) < 0) {
-                    child_smallest = child_right;
-                }
-            }
-
-            if (child_smallest != index) {
-                void *temp = array_get(h->array, index);
-                array_set(h->array, index, array_get(h->array, child_smallest));
-                array_set(h->array, child_smallest, temp);
-                index = child_smallest;
-            } else {
-                break;
-            }
-        }
+    /* Move the hole left by the root down to where the last node belongs. */
+    if (size > 0) {
+        sift_down(h, data, size, 0, last_node);
     }
 
     return root_node;
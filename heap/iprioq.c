@@ -0,0 +1,296 @@
+/*
+ * Manages an indexed heap-based priority queue. The heap has the layout of
+ * heap.c, a d-ary heap in cache line aligned storage that is sifted by moving
+ * a hole, but every entry also carries its handle, and a table indexed by
+ * handle holds the current position of every entry. Each move of an entry
+ * updates its position, so a handle leads straight to its entry.
+ *
+ * Handles of popped and removed entries are kept on a stack and reused, so
+ * the position table never grows past the largest size of the queue.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "iprioq.h"
+#include "prioq.h"
+
+#define SIZE_ARRAY 100
+
+#define CACHE_LINE 64
+
+typedef long int longtype;
+
+struct iprioq_entry {
+    void *p;
+    longtype handle;
+};
+
+struct iheap {
+    /* Start of the aligned allocation, d - 1 entries before data */
+    struct iprioq_entry *base;
+    struct iprioq_entry *data;
+    longtype size;
+    longtype capacity;
+    /* Position in data of the entry of every handle, -1 for unused handles */
+    longtype *pos;
+    /* Unused handles below n_handles */
+    longtype *free_handles;
+    longtype n_free;
+    /* Number of handles handed out so far, and room in pos and free_handles */
+    longtype n_handles;
+    longtype handles_capacity;
+    longtype d;
+    int (*compare)(const void *a, const void *b);
+};
+
+/* Allocate room for 'capacity' entries plus d - 1 entries of padding, cache
+ * line aligned. Return NULL if an error occurred. */
+static struct iprioq_entry *entries_alloc(longtype d, longtype capacity) {
+    void *p;
+    unsigned long bytes = (unsigned long) (capacity + d - 1)
+                          * sizeof(struct iprioq_entry);
+    if (posix_memalign(&p, CACHE_LINE, bytes) != 0) {
+        return NULL;
+    }
+    return p;
+}
+
+iprioq *iprioq_init(int (*compare)(const void *, const void *)) {
+    struct iheap *h = malloc(sizeof(struct iheap));
+    if (h == NULL) {
+        return NULL;
+    }
+
+    h->d = PRIOQ_ARITY;
+    h->compare = compare;
+    h->base = entries_alloc(h->d, SIZE_ARRAY);
+    h->pos = malloc(SIZE_ARRAY * sizeof(longtype));
+    h->free_handles = malloc(SIZE_ARRAY * sizeof(longtype));
+    if (h->base == NULL || h->pos == NULL || h->free_handles == NULL) {
+        free(h->base);
+        free(h->pos);
+        free(h->free_handles);
+        free(h);
+        return NULL;
+    }
+
+    h->data = h->base + h->d - 1;
+    h->size = 0;
+    h->capacity = SIZE_ARRAY;
+    h->n_free = 0;
+    h->n_handles = 0;
+    h->handles_capacity = SIZE_ARRAY;
+    return h;
+}
+
+long int iprioq_size(const iprioq *q) {
+    if (q == NULL) {
+        return -1;
+    }
+
+    return q->size;
+}
+
+int iprioq_cleanup(iprioq *q, void (*free_func)(void *)) {
+    if (q == NULL) {
+        return -1;
+    }
+
+    if (free_func == NULL) {
+        free_func = free;
+    }
+
+    for (longtype i = 0; i < q->size; i++) {
+        free_func(q->data[i].p);
+    }
+
+    free(q->base);
+    free(q->pos);
+    free(q->free_handles);
+    free(q);
+    return 0;
+}
+
+/* Return 1 if handle belongs to an element in the queue, 0 otherwise. */
+static int handle_valid(const struct iheap *h, longtype handle) {
+    return handle >= 0 && handle < h->n_handles && h->pos[handle] >= 0;
+}
+
+/* Move a hole at position 'hole' towards the root until e fits, then store
+ * e there. Returns the final position of e. */
+static longtype sift_up(struct iheap *h, longtype hole, struct iprioq_entry e) {
+    struct iprioq_entry *data = h->data;
+
+    while (hole > 0) {
+        longtype parent = (hole - 1) / h->d;
+        if (h->compare(e.p, data[parent].p) >= 0) {
+            break;
+        }
+        data[hole] = data[parent];
+        h->pos[data[hole].handle] = hole;
+        hole = parent;
+    }
+    data[hole] = e;
+    h->pos[e.handle] = hole;
+
+    return hole;
+}
+
+/* Move a hole at position 'hole' towards the leaves until e fits, then store
+ * e there. */
+static void sift_down(struct iheap *h, longtype hole, struct iprioq_entry e) {
+    struct iprioq_entry *data = h->data;
+    longtype size = h->size;
+    longtype d = h->d;
+
+    while (1) {
+        longtype first_child = hole * d + 1;
+        if (first_child >= size) {
+            break;
+        }
+
+        longtype end_child = first_child + d < size ? first_child + d : size;
+        longtype child_smallest = first_child;
+        for (longtype child = first_child + 1; child < end_child; child++) {
+            if (h->compare(data[child].p, data[child_smallest].p) < 0) {
+                child_smallest = child;
+            }
+        }
+
+        if (h->compare(data[child_smallest].p, e.p) >= 0) {
+            break;
+        }
+        data[hole] = data[child_smallest];
+        h->pos[data[hole].handle] = hole;
+        hole = child_smallest;
+    }
+    data[hole] = e;
+    h->pos[e.handle] = hole;
+}
+
+/* Return an unused handle, -1 if an error occurred. */
+static longtype handle_alloc(struct iheap *h) {
+    if (h->n_free > 0) {
+        return h->free_handles[--h->n_free];
+    }
+
+    if (h->n_handles == h->handles_capacity) {
+        longtype new_capacity = (h->handles_capacity + 1) * 2;
+        longtype *pos = realloc(h->pos,
+                                (unsigned long) new_capacity * sizeof(longtype));
+        if (pos == NULL) {
+            return -1;
+        }
+        h->pos = pos;
+
+        longtype *free_handles = realloc(h->free_handles,
+                                         (unsigned long) new_capacity
+                                         * sizeof(longtype));
+        if (free_handles == NULL) {
+            return -1;
+        }
+        h->free_handles = free_handles;
+        h->handles_capacity = new_capacity;
+    }
+
+    return h->n_handles++;
+}
+
+long int iprioq_insert(iprioq *q, void *p) {
+    if (q == NULL || p == NULL) {
+        return -1;
+    }
+
+    if (q->size == q->capacity) {
+        longtype new_capacity = (q->capacity + 1) * 2;
+        struct iprioq_entry *base = entries_alloc(q->d, new_capacity);
+        if (base == NULL) {
+            return -1;
+        }
+        memcpy(base + q->d - 1, q->data,
+               (unsigned long) q->size * sizeof(struct iprioq_entry));
+        free(q->base);
+        q->base = base;
+        q->data = base + q->d - 1;
+        q->capacity = new_capacity;
+    }
+
+    longtype handle = handle_alloc(q);
+    if (handle < 0) {
+        return -1;
+    }
+
+    struct iprioq_entry e = {p, handle};
+    sift_up(q, q->size++, e);
+    return handle;
+}
+
+void *iprioq_get(const iprioq *q, long int handle) {
+    if (q == NULL || !handle_valid(q, handle)) {
+        return NULL;
+    }
+
+    return q->data[q->pos[handle]].p;
+}
+
+int iprioq_decrease_key(iprioq *q, long int handle, void *p) {
+    if (q == NULL || p == NULL || !handle_valid(q, handle)) {
+        return -1;
+    }
+
+    struct iprioq_entry e = {p, handle};
+    sift_up(q, q->pos[handle], e);
+    return 0;
+}
+
+int iprioq_update(iprioq *q, long int handle, void *p) {
+    if (q == NULL || p == NULL || !handle_valid(q, handle)) {
+        return -1;
+    }
+
+    struct iprioq_entry e = {p, handle};
+    longtype index = q->pos[handle];
+    if (sift_up(q, index, e) == index) {
+        sift_down(q, index, e);
+    }
+    return 0;
+}
+
+/* Take the entry at position 'index' out of the heap and fill its place
+ * with the last entry. Returns the element of the removed entry. */
+static void *heap_remove_at(struct iheap *h, longtype index) {
+    struct iprioq_entry removed = h->data[index];
+    struct iprioq_entry last = h->data[--h->size];
+
+    h->pos[removed.handle] = -1;
+    h->free_handles[h->n_free++] = removed.handle;
+
+    if (index < h->size) {
+        /* The last entry came from another subtree, so it may belong above
+         * or below the hole. */
+        if (sift_up(h, index, last) == index) {
+            sift_down(h, index, last);
+        }
+    }
+
+    return removed.p;
+}
+
+void *iprioq_remove(iprioq *q, long int handle) {
+    if (q == NULL || !handle_valid(q, handle)) {
+        return NULL;
+    }
+
+    return heap_remove_at(q, q->pos[handle]);
+}
+
+void *iprioq_pop(iprioq *q) {
+    if (q == NULL || q->size == 0) {
+        return NULL;
+    }
+
+    return heap_remove_at(q, 0);
+}
@@ -0,0 +1,59 @@
+#ifndef IPRIOQ_H
+#define IPRIOQ_H
+
+/* Indexed priority queue interface
+ * Same ordering as prioq.h, but every inserted element gets a handle that
+ * stays valid while the element is in the queue, whichever way it moves
+ * through the heap. Through its handle an element can be looked up, moved
+ * after its priority changed or removed, each in O(log n), instead of
+ * inserting duplicates and skipping stale entries when they are popped.
+ *
+ * A handle becomes invalid once its element is popped or removed, and may
+ * then be handed out again by a later insert. */
+
+/* Handle to indexed priority queue data structure. */
+struct iheap;
+
+typedef struct iheap iprioq;
+
+/* Create indexed priority queue where the elements are ordered using the
+ * compare function, see struct heap in prioq.h.
+ * Return a pointer to empty iprioq on success, NULL on error. */
+iprioq *iprioq_init(int (*compare)(const void *, const void *));
+
+/* Return the size of indexed priority queue.
+ * Returns -1 if an error occurred. */
+long int iprioq_size(const iprioq *q);
+
+/* Free the elements in the queue using the free_func() parameter, then free
+ * the queue itself. If 'free_func' is NULL the standard free() is used.
+ * Return 0 on success, something else on error. */
+int iprioq_cleanup(iprioq *q, void (*free_func)(void *));
+
+/* Insert the element p into the queue q.
+ * Return the handle of p on success, -1 on error. */
+long int iprioq_insert(iprioq *q, void *p);
+
+/* Return the element of 'handle', NULL on error. */
+void *iprioq_get(const iprioq *q, long int handle);
+
+/* Replace the element of 'handle' by p, which may be the same element, and
+ * restore the heap order after its priority was lowered (moved towards the
+ * top). Cheaper than iprioq_update(), p must not compare greater than the
+ * element it replaces did.
+ * Return 0 on success, -1 on error. */
+int iprioq_decrease_key(iprioq *q, long int handle, void *p);
+
+/* Same as iprioq_decrease_key(), for any change of priority.
+ * Return 0 on success, -1 on error. */
+int iprioq_update(iprioq *q, long int handle, void *p);
+
+/* Remove the element of 'handle' from the queue and return it.
+ * Return NULL on error. */
+void *iprioq_remove(iprioq *q, long int handle);
+
+/* Pop the top element from the queue and return it.
+ * Return a pointer to top element on success, NULL on error. */
+void *iprioq_pop(iprioq *q);
+
+#endif
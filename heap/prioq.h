@@ -9,15 +9,35 @@ struct heap {
        to, or greater than zero if a is found respectively, to be less than, to
        match, or be greater than b. */
     int (*compare)(const void *a, const void *b);
+    /* Number of children per node */
+    long int d;
 };
 
 typedef struct heap prioq;
 
+/* Number of children per node of queues created with prioq_init(). */
+#define PRIOQ_ARITY 4
+
 /* Create priority queue where the elements are ordered using the compare
  * function.
  * Return a pointer to empty prioq on success, NULL on error. */
 prioq *prioq_init(int (*compare)(const void *, const void *));
 
+/* Same as prioq_init(), but the heap gives every node 'd' children, at least
+ * 2. Wider heaps are shallower, so a pop takes fewer cache misses but more
+ * compares per level. All children of a node share one cache line if 'd' is
+ * a power of two of at most 8 (with 8 byte pointers).
+ * Return a pointer to empty prioq on success, NULL on error. */
+prioq *prioq_init_dary(int (*compare)(const void *, const void *), long int d);
+
+/* Create priority queue holding the n elements at 'elements', ordered using
+ * the compare function. The pointers are copied, the heap is built bottom-up
+ * in O(n) instead of inserting the elements one by one. No element may be
+ * NULL.
+ * Return a pointer to the prioq on success, NULL on error. */
+prioq *prioq_init_from(void **elements, long int n,
+                       int (*compare)(const void *, const void *));
+
 /* Return the size of priority queue.
  * Returns -1 if an error occurred. */
 long int prioq_size(const prioq *q);
@@ -31,6 +51,13 @@ int prioq_cleanup(prioq *q, void (*free_func)(void *));
  * Return 0 on success, something else on error. */
 int prioq_insert(prioq *q, void *p);
 
+/* Insert the n elements at 'elements' into the priority queue q. Large
+ * batches are appended and the whole heap is rebuilt bottom-up, small ones
+ * are sifted up one by one, whichever takes fewer compares. No element may
+ * be NULL. On error q is left unchanged.
+ * Return 0 on success, something else on error. */
+int prioq_insert_many(prioq *q, void **elements, long int n);
+
 /* Pop the top element from the prioq and return it.
    Return a pointer to top element on success, NULL on error. */
 void *prioq_pop(prioq *q);
@@ -0,0 +1,284 @@
+/*
+ * Implements a radix heap and a bucket queue for monotone integer keys.
+ *
+ * Radix heap: bucket 0 holds the elements whose key equals the last popped
+ * key, bucket b > 0 the elements whose key first differs from it in bit
+ * b - 1, counting from the lowest bit. Pop takes from bucket 0. When it is
+ * empty, the smallest key of the first nonempty bucket b becomes the last
+ * popped key, and every element of bucket b shares all bits above bit b - 1
+ * with it, so each of them moves to a bucket below b. An element moves down
+ * at most once per bit of its distance to the last popped key.
+ *
+ * Bucket queue: one bucket per key, in a circular array indexed by the key
+ * modulo the range. All keys in the queue lie less than 'range' above the
+ * last popped key, so a bucket never holds two different keys.
+ */
+
+#include <stdlib.h>
+
+#include "array.h"
+#include "radix_heap.h"
+
+/* One bucket for every bit of a key, plus bucket 0. */
+#define RADIX_BUCKETS (sizeof(unsigned long) * 8 + 1)
+
+#define BUCKET_SIZE 4
+
+typedef long int longtype;
+
+struct radix_entry {
+    unsigned long key;
+    void *p;
+};
+
+struct radix_bucket {
+    struct radix_entry *data;
+    longtype size;
+    longtype capacity;
+};
+
+struct radix_heap {
+    struct radix_bucket buckets[RADIX_BUCKETS];
+    /* Key popped last, 0 before the first pop */
+    unsigned long last;
+    longtype size;
+};
+
+struct bucket_queue {
+    /* Bucket of every key modulo range, NULL until first used */
+    struct array **buckets;
+    unsigned long range;
+    /* Key popped last, every key in the queue is at least this */
+    unsigned long last;
+    longtype size;
+};
+
+/* Return the bucket of key relative to the last popped key 'last'. */
+static longtype bucket_of(unsigned long last, unsigned long key) {
+    if (key == last) {
+        return 0;
+    }
+
+    return (longtype) (sizeof(unsigned long) * 8)
+           - __builtin_clzl(key ^ last);
+}
+
+/* Make room for at least 'n' more entries in bucket b.
+ * Return 0 if successful, -1 otherwise. */
+static int bucket_reserve(struct radix_bucket *b, longtype n) {
+    if (b->size + n <= b->capacity) {
+        return 0;
+    }
+
+    longtype new_capacity = b->capacity > 0 ? b->capacity * 2 : BUCKET_SIZE;
+    while (new_capacity < b->size + n) {
+        new_capacity *= 2;
+    }
+
+    struct radix_entry *data = realloc(b->data, (unsigned long) new_capacity
+                                                * sizeof(struct radix_entry));
+    if (data == NULL) {
+        return -1;
+    }
+
+    b->data = data;
+    b->capacity = new_capacity;
+    return 0;
+}
+
+struct radix_heap *radix_heap_init(void) {
+    struct radix_heap *h = calloc(1, sizeof(struct radix_heap));
+    if (h == NULL) {
+        return NULL;
+    }
+
+    return h;
+}
+
+long int radix_heap_size(const struct radix_heap *h) {
+    if (h == NULL) {
+        return -1;
+    }
+
+    return h->size;
+}
+
+int radix_heap_cleanup(struct radix_heap *h, void (*free_func)(void *)) {
+    if (h == NULL) {
+        return -1;
+    }
+
+    if (free_func == NULL) {
+        free_func = free;
+    }
+
+    for (unsigned long i = 0; i < RADIX_BUCKETS; i++) {
+        struct radix_bucket *b = &h->buckets[i];
+        for (longtype j = 0; j < b->size; j++) {
+            free_func(b->data[j].p);
+        }
+        free(b->data);
+    }
+
+    free(h);
+    return 0;
+}
+
+int radix_heap_insert(struct radix_heap *h, unsigned long key, void *p) {
+    if (h == NULL || p == NULL || key < h->last) {
+        return -1;
+    }
+
+    struct radix_bucket *b = &h->buckets[bucket_of(h->last, key)];
+    if (bucket_reserve(b, 1) != 0) {
+        return -1;
+    }
+
+    b->data[b->size].key = key;
+    b->data[b->size].p = p;
+    b->size++;
+    h->size++;
+    return 0;
+}
+
+/* Empty the first nonempty bucket into the buckets below it, relative to its
+ * smallest key, which becomes the last popped key. Room is reserved in every
+ * target bucket first, so a failed allocation leaves the heap unchanged.
+ * Return 0 if successful, -1 otherwise. */
+static int radix_heap_refill(struct radix_heap *h) {
+    unsigned long i = 1;
+    while (h->buckets[i].size == 0) {
+        i++;
+    }
+
+    struct radix_bucket *b = &h->buckets[i];
+    unsigned long min = b->data[0].key;
+    for (longtype j = 1; j < b->size; j++) {
+        if (b->data[j].key < min) {
+            min = b->data[j].key;
+        }
+    }
+
+    longtype counts[RADIX_BUCKETS] = {0};
+    for (longtype j = 0; j < b->size; j++) {
+        counts[bucket_of(min, b->data[j].key)]++;
+    }
+    for (unsigned long k = 0; k < i; k++) {
+        if (counts[k] > 0 && bucket_reserve(&h->buckets[k], counts[k]) != 0) {
+            return -1;
+        }
+    }
+
+    h->last = min;
+    for (longtype j = 0; j < b->size; j++) {
+        struct radix_bucket *target = &h->buckets[bucket_of(min, b->data[j].key)];
+        target->data[target->size++] = b->data[j];
+    }
+    b->size = 0;
+
+    return 0;
+}
+
+void *radix_heap_pop(struct radix_heap *h, unsigned long *key) {
+    if (h == NULL || h->size == 0) {
+        return NULL;
+    }
+
+    if (h->buckets[0].size == 0 && radix_heap_refill(h) != 0) {
+        return NULL;
+    }
+
+    struct radix_bucket *b = &h->buckets[0];
+    void *p = b->data[--b->size].p;
+    h->size--;
+    if (key != NULL) {
+        *key = h->last;
+    }
+
+    return p;
+}
+
+struct bucket_queue *bucket_queue_init(unsigned long range) {
+    if (range == 0) {
+        return NULL;
+    }
+
+    struct bucket_queue *q = malloc(sizeof(struct bucket_queue));
+    if (q == NULL) {
+        return NULL;
+    }
+
+    q->buckets = calloc(range, sizeof(struct array *));
+    if (q->buckets == NULL) {
+        free(q);
+        return NULL;
+    }
+
+    q->range = range;
+    q->last = 0;
+    q->size = 0;
+    return q;
+}
+
+long int bucket_queue_size(const struct bucket_queue *q) {
+    if (q == NULL) {
+        return -1;
+    }
+
+    return q->size;
+}
+
+int bucket_queue_cleanup(struct bucket_queue *q, void (*free_func)(void *)) {
+    if (q == NULL) {
+        return -1;
+    }
+
+    for (unsigned long i = 0; i < q->range; i++) {
+        array_cleanup(q->buckets[i], free_func);
+    }
+
+    free(q->buckets);
+    free(q);
+    return 0;
+}
+
+int bucket_queue_insert(struct bucket_queue *q, unsigned long key, void *p) {
+    if (q == NULL || p == NULL || key < q->last || key - q->last >= q->range) {
+        return -1;
+    }
+
+    unsigned long index = key % q->range;
+    if (q->buckets[index] == NULL) {
+        q->buckets[index] = array_init(BUCKET_SIZE);
+        if (q->buckets[index] == NULL) {
+            return -1;
+        }
+    }
+
+    if (array_append(q->buckets[index], p) != 0) {
+        return -1;
+    }
+
+    q->size++;
+    return 0;
+}
+
+void *bucket_queue_pop(struct bucket_queue *q, unsigned long *key) {
+    if (q == NULL || q->size == 0) {
+        return NULL;
+    }
+
+    /* The queue is not empty, so a bucket within range holds a key. */
+    unsigned long index = q->last % q->range;
+    while (q->buckets[index] == NULL || array_size(q->buckets[index]) == 0) {
+        q->last++;
+        index = index + 1 == q->range ? 0 : index + 1;
+    }
+
+    q->size--;
+    if (key != NULL) {
+        *key = q->last;
+    }
+
+    return array_pop(q->buckets[index]);
+}
@@ -0,0 +1,74 @@
+#ifndef RADIX_HEAP_H
+#define RADIX_HEAP_H
+
+/* Monotone integer priority queue interface
+ * Two priority queues with the insert/pop interface of prioq.h, for
+ * elements with an unsigned integer key, which are popped smallest key
+ * first. Both are monotone: a key may never be smaller than the key popped
+ * last, as with simulation clocks or Dijkstra's algorithm with non-negative
+ * integer weights. Neither calls a compare function.
+ *
+ * The radix heap sorts elements into 65 buckets by the highest bit in which
+ * their key differs from the last popped key. An element only moves to
+ * lower buckets, so insert and pop take O(log C) amortized for keys at most
+ * C above the last popped key, whatever the number of elements.
+ *
+ * The bucket queue keeps one bucket per key in a circular array of 'range'
+ * buckets, for keys less than 'range' above the last popped key. Insert
+ * takes O(1), pop O(1) amortized plus one bucket per skipped empty key, so
+ * it suits small ranges that are densely used.
+ *
+ * Elements with equal keys are popped in no particular order. */
+
+/* Handle to radix heap data structure. */
+struct radix_heap;
+
+/* Handle to bucket queue data structure. */
+struct bucket_queue;
+
+/* Create an empty radix heap.
+ * Return a pointer to the radix heap on success, NULL on error. */
+struct radix_heap *radix_heap_init(void);
+
+/* Return the number of elements in the radix heap.
+ * Returns -1 if an error occurred. */
+long int radix_heap_size(const struct radix_heap *h);
+
+/* Free the elements in the radix heap using the free_func() parameter, then
+ * free the radix heap itself. If 'free_func' is NULL the standard free() is
+ * used.
+ * Return 0 on success, something else on error. */
+int radix_heap_cleanup(struct radix_heap *h, void (*free_func)(void *));
+
+/* Insert the element p with priority 'key' into the radix heap. The key must
+ * not be smaller than the key popped last.
+ * Return 0 on success, something else on error. */
+int radix_heap_insert(struct radix_heap *h, unsigned long key, void *p);
+
+/* Pop an element with the smallest key from the radix heap and return it.
+ * If 'key' is not NULL the key of the element is stored in *key.
+ * Return a pointer to the element on success, NULL on error. */
+void *radix_heap_pop(struct radix_heap *h, unsigned long *key);
+
+/* Create an empty bucket queue for keys less than 'range' above the last
+ * popped key, starting from key 0.
+ * Return a pointer to the bucket queue on success, NULL on error. */
+struct bucket_queue *bucket_queue_init(unsigned long range);
+
+/* Return the number of elements in the bucket queue.
+ * Returns -1 if an error occurred. */
+long int bucket_queue_size(const struct bucket_queue *q);
+
+/* Same as radix_heap_cleanup(), for a bucket queue. */
+int bucket_queue_cleanup(struct bucket_queue *q, void (*free_func)(void *));
+
+/* Insert the element p with priority 'key' into the bucket queue. The key
+ * must not be smaller than the key popped last, nor 'range' or more above
+ * it.
+ * Return 0 on success, something else on error. */
+int bucket_queue_insert(struct bucket_queue *q, unsigned long key, void *p);
+
+/* Same as radix_heap_pop(), for a bucket queue. */
+void *bucket_queue_pop(struct bucket_queue *q, unsigned long *key);
+
+#endif
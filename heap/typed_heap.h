@@ -0,0 +1,195 @@
+#ifndef TYPED_HEAP_H
+#define TYPED_HEAP_H
+
+/* Typed priority queue interface
+ * DEFINE_TYPED_HEAP(name, key_type, payload_type, less) defines struct name,
+ * a heap of (key, payload) entries that are stored by value in one
+ * contiguous array, together with these static inline functions:
+ *
+ *   struct name *name_init(void);
+ *   int name_insert(struct name *h, key_type key, payload_type payload);
+ *   int name_top(const struct name *h, key_type *key, payload_type *payload);
+ *   int name_pop(struct name *h, key_type *key, payload_type *payload);
+ *   long int name_size(const struct name *h);
+ *   void name_cleanup(struct name *h);
+ *
+ * less(a, b) is a macro or inline function that is nonzero if key a is to
+ * be popped before key b. It is expanded at every comparison, so unlike
+ * prioq there is no call through a function pointer and no pointer to
+ * follow to reach a key. Keys and payloads are copied in and out, the heap
+ * never owns or frees what a payload points to.
+ *
+ * The layout is the one of prioq: a TYPED_HEAP_ARITY-ary heap whose sibling
+ * groups start on a multiple of TYPED_HEAP_ARITY entries past a cache line
+ * aligned address.
+ *
+ * name_init() returns NULL on error. name_insert() returns 0 on success and
+ * -1 on error. name_top() and name_pop() store the first entry in *key and
+ * *payload, either of which may be NULL, and return 0, or -1 if the heap is
+ * empty. name_size() returns -1 if an error occurred. */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Number of children per node. */
+#define TYPED_HEAP_ARITY 4
+
+#define TYPED_HEAP_LINE 64
+
+/* Initial number of entries. */
+#define TYPED_HEAP_SIZE 100
+
+/* Orders numeric keys smallest first. Floating point keys must not be NaN. */
+#define TYPED_HEAP_LESS(a, b) ((a) < (b))
+
+/* Orders numeric keys largest first. */
+#define TYPED_HEAP_GREATER(a, b) ((a) > (b))
+
+#define DEFINE_TYPED_HEAP(name, key_type, payload_type, less)                  \
+struct name##_entry {                                                          \
+    key_type key;                                                              \
+    payload_type payload;                                                      \
+};                                                                             \
+                                                                               \
+struct name {                                                                  \
+    /* Start of the aligned allocation, TYPED_HEAP_ARITY - 1 entries before    \
+     * data */                                                                 \
+    struct name##_entry *base;                                                 \
+    struct name##_entry *data;                                                 \
+    long int size;                                                             \
+    long int capacity;                                                         \
+};                                                                             \
+                                                                               \
+static inline struct name##_entry *name##_alloc(long int capacity) {           \
+    size_t bytes = (size_t) (capacity + TYPED_HEAP_ARITY - 1)                  \
+                   * sizeof(struct name##_entry);                              \
+    bytes = (bytes + TYPED_HEAP_LINE - 1) / TYPED_HEAP_LINE * TYPED_HEAP_LINE; \
+    return aligned_alloc(TYPED_HEAP_LINE, bytes);                              \
+}                                                                              \
+                                                                               \
+static inline struct name *name##_init(void) {                                 \
+    struct name *h = malloc(sizeof(struct name));                              \
+    if (h == NULL) {                                                           \
+        return NULL;                                                           \
+    }                                                                          \
+                                                                               \
+    h->base = name##_alloc(TYPED_HEAP_SIZE);                                   \
+    if (h->base == NULL) {                                                     \
+        free(h);                                                               \
+        return NULL;                                                           \
+    }                                                                          \
+    h->data = h->base + TYPED_HEAP_ARITY - 1;                                  \
+    h->size = 0;                                                               \
+    h->capacity = TYPED_HEAP_SIZE;                                             \
+    return h;                                                                  \
+}                                                                              \
+                                                                               \
+static inline int name##_insert(struct name *h, key_type key,                  \
+                                payload_type payload) {                        \
+    if (h == NULL) {                                                           \
+        return -1;                                                             \
+    }                                                                          \
+                                                                               \
+    if (h->size == h->capacity) {                                              \
+        long int new_capacity = (h->capacity + 1) * 2;                         \
+        struct name##_entry *new_base = name##_alloc(new_capacity);            \
+        if (new_base == NULL) {                                                \
+            return -1;                                                         \
+        }                                                                      \
+        memcpy(new_base + TYPED_HEAP_ARITY - 1, h->data,                       \
+               (size_t) h->size * sizeof(struct name##_entry));                \
+        free(h->base);                                                         \
+        h->base = new_base;                                                    \
+        h->data = new_base + TYPED_HEAP_ARITY - 1;                             \
+        h->capacity = new_capacity;                                            \
+    }                                                                          \
+                                                                               \
+    struct name##_entry *data = h->data;                                       \
+    long int hole = h->size++;                                                 \
+    while (hole > 0) {                                                         \
+        long int parent = (hole - 1) / TYPED_HEAP_ARITY;                       \
+        if (!(less(key, data[parent].key))) {                                  \
+            break;                                                             \
+        }                                                                      \
+        data[hole] = data[parent];                                             \
+        hole = parent;                                                         \
+    }                                                                          \
+    data[hole].key = key;                                                      \
+    data[hole].payload = payload;                                              \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline int name##_top(const struct name *h, key_type *key,              \
+                             payload_type *payload) {                          \
+    if (h == NULL || h->size == 0) {                                           \
+        return -1;                                                             \
+    }                                                                          \
+                                                                               \
+    if (key != NULL) {                                                         \
+        *key = h->data[0].key;                                                 \
+    }                                                                          \
+    if (payload != NULL) {                                                     \
+        *payload = h->data[0].payload;                                         \
+    }                                                                          \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline int name##_pop(struct name *h, key_type *key,                    \
+                             payload_type *payload) {                          \
+    if (name##_top(h, key, payload) != 0) {                                    \
+        return -1;                                                             \
+    }                                                                          \
+                                                                               \
+    struct name##_entry *data = h->data;                                       \
+    long int size = --h->size;                                                 \
+    if (size == 0) {                                                           \
+        return 0;                                                              \
+    }                                                                          \
+                                                                               \
+    struct name##_entry last = data[size];                                     \
+    long int hole = 0;                                                         \
+    while (1) {                                                                \
+        long int first_child = hole * TYPED_HEAP_ARITY + 1;                    \
+        if (first_child >= size) {                                             \
+            break;                                                             \
+        }                                                                      \
+                                                                               \
+        long int end_child = first_child + TYPED_HEAP_ARITY < size             \
+                                 ? first_child + TYPED_HEAP_ARITY : size;      \
+        long int child_smallest = first_child;                                 \
+        for (long int child = first_child + 1; child < end_child; child++) {   \
+            if (less(data[child].key, data[child_smallest].key)) {             \
+                child_smallest = child;                                        \
+            }                                                                  \
+        }                                                                      \
+                                                                               \
+        if (!(less(data[child_smallest].key, last.key))) {                     \
+            break;                                                             \
+        }                                                                      \
+        data[hole] = data[child_smallest];                                     \
+        hole = child_smallest;                                                 \
+    }                                                                          \
+    data[hole] = last;                                                         \
+                                                                               \
+    return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline long int name##_size(const struct name *h) {                     \
+    if (h == NULL) {                                                           \
+        return -1;                                                             \
+    }                                                                          \
+                                                                               \
+    return h->size;                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_cleanup(struct name *h) {                            \
+    if (h == NULL) {                                                           \
+        return;                                                                \
+    }                                                                          \
+                                                                               \
+    free(h->base);                                                             \
+    free(h);                                                                   \
+}
+
+#endif